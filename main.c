@@ -8,15 +8,40 @@
  *
  * gcc -o ZeldasBirthdayRomFixer \
  *     -Wall -Wextra -std=c99 -pedantic \
- *     main.c
+ *     main.c -pthread
  *
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE // mmap, copy_file_range
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <pthread.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #include "include/incbin.h"
 
@@ -28,8 +53,11 @@
 #define OOT_SCENE_TABLE_END    0x00BA1448
 #define OOT_OBJECT_TABLE_START 0x00B9E6C8
 #define OOT_OBJECT_TABLE_END   0x00B9F358
+#define OOT_OBJECT_TABLE_LENGTH 402
 #define OOT_DMADATA_START      0x00012F70
 #define OOT_DMADATA_END        0x00019030
+#define OOT_CODE_START         0x00A94000
+#define OOT_CODE_END           0x00BCEF30
 
 #define SCENE_UNUSED_FIRST 0x0004
 #define SCENE_UNUSED_LAST  0x0006
@@ -52,783 +80,6914 @@ INCBIN(LadderObjectPayload, PLDIR "ladder-object-payload.bin");
 #define PL_LADDER_ACTOR_ID 0x00E2
 #define PL_LADDER_OBJECT_ID 0x013F
 
+// rom ranges the misc patches write to at hard-coded offsets
+enum patchTarget
+{
+	PATCH_SARIA, // En_Sa overlay
+	PATCH_RAURU, // rauru cutscene
+	PATCH_ENTRANCE, // entrance ENTR_SPOT20_1
+	PATCH_ZELDA_OBJECT, // ganon battle object list
+	PATCH_ARENA, // ganon battle arena cutscene
+	PATCH_ZL3, // Zl3 overlay
+	PATCH_ZELDA_VOICE, // one per clip, which the patch zeroes
+	PATCH_ZELDA_VOICE_LAST = PATCH_ZELDA_VOICE + 4,
+	PATCH_EAGLE_SCENE, // see header_patch()
+	PATCH_EAGLE_ROOM,
+	PATCH_COUNT
+};
+
+static const struct { const char *name; uint32_t start, end; } gPatchTarget[PATCH_COUNT] = {
+	{ "saria", 0x00EAB540 + 0x9C4, 0x00EAB540 + 0xDA0 },
+	{ "rauru cutscene", 0x02B0D681, 0x02B0D682 },
+	{ "ganon battle entrance", 0x00B9FE18, 0x00B9FE28 },
+	{ "ganon battle zelda object", 0x0353F031, 0x0353F066 },
+	{ "ganon battle arena cutscene", 0x03536328, 0x03536330 },
+	{ "ganon battle zelda", 0x00F090B0 + 0x71D4, 0x00F090B0 + 0x839C },
+	{ "zelda voice", 0x00289720, 0x00289720 + 0xF9C },
+	{ "zelda voice", 0x0028A6C0, 0x0028A6C0 + 0x13CC },
+	{ "zelda voice", 0x0028BA90, 0x0028BA90 + 0x226C },
+	{ "zelda voice", 0x0028DD00, 0x0028DD00 + 0xD92 },
+	{ "zelda voice", 0x0028EAA0, 0x0028EAA0 + 0x161E },
+	{ "eagle labyrinth scene", 0x03913000, 0x03913000 + 0x1A7D0 },
+	{ "eagle labyrinth room", 0x03986000, 0x0398A7E0 },
+};
+
+// command line options
+static struct
+{
+	const char *crcCache; // --crc-cache=FILE
+	bool defrag; // --defrag
+	bool dedup; // --dedup
+	bool compress; // --compress
+	bool lowMem; // --low-mem
+	const char *compressSkip; // --compress-skip=LIST
+	bool stats; // --stats[=FILE]
+	const char *statsFn;
+	bool perf; // --perf
+	const char *index; // --index=FILE
+	const char *incremental; // --incremental=FILE
+} gOpt;
+
 //
 //
-// crc copy-pasta
+// stats
 //
 //
-/* snesrc - SNES Recompiler
- *
- * Mar 23, 2010: addition by spinout to actually fix CRC if it is incorrect
- *
- * Copyright notice for this file:
- *  Copyright (C) 2005 Parasyte
- *
- * Based on uCON64's N64 checksum algorithm by Andreas Sterbenz
- *
- * This program is free software; you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation; either version 2 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program; if not, write to the Free Software
- * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
- */
 
-#include <assert.h>
+/* phases of fixing a file, timed for --stats */
+enum statPhase
+{
+	PHASE_LOAD, // reading, mapping, or decompressing the input
+	PHASE_INCREMENTAL, // hashing files for --incremental
+	PHASE_UNUSED, // clearing unused dmadata and scene table entries
+	PHASE_SCENES, // walking every scene and room
+	PHASE_OBJECTS, // object table check
+	PHASE_ACTORS, // actor table check
+	PHASE_PATCHES, // dmadata write-back, overlap check, misc patches
+	PHASE_DEDUP,
+	PHASE_DEFRAG,
+	PHASE_CHECKSUM,
+	PHASE_INDEX, // --index
+	PHASE_SAVE, // writing the result, a patch, or a compressed rom
+	PHASE_COUNT
+};
 
-#define ROL(i, b) (((i) << (b)) | ((i) >> (32 - (b))))
-#define BYTES2LONG(b) ( (b)[0] << 24 | \
-                        (b)[1] << 16 | \
-                        (b)[2] <<  8 | \
-                        (b)[3] )
+enum statCount
+{
+	STAT_HEADERS, // headers walked
+	STAT_ROOMS, // room files walked
+	STAT_ACTORS_REMOVED,
+	STAT_DMA_LOOKUPS,
+	STAT_DMA_ADDS,
+	STAT_DMA_UPDATES, // entries resized or moved
+	STAT_BYTES_WRITTEN, // bytes changed through the write helpers
+	STAT_SCENES_SKIPPED, // unchanged since the last --incremental run
+	STAT_COUNT
+};
 
-#define N64_HEADER_SIZE  0x40
-#define N64_BC_SIZE      (0x1000 - N64_HEADER_SIZE)
+static const char *gPhaseName[PHASE_COUNT] = {
+	"load", "incremental", "unused", "scenes", "objects", "actors",
+	"patches", "dedup", "defrag", "checksum", "index", "save"
+};
 
-#define N64_CRC1         0x10
-#define N64_CRC2         0x14
+static const char *gStatName[STAT_COUNT] = {
+	"headers", "rooms", "actors_removed",
+	"dma_lookups", "dma_adds", "dma_updates", "bytes_written", "scenes_skipped"
+};
 
-#define CHECKSUM_START   0x00001000
-#define CHECKSUM_LENGTH  0x00100000
-#define CHECKSUM_CIC6102 0xF8CA4DDC
-#define CHECKSUM_CIC6103 0xA3886759
-#define CHECKSUM_CIC6105 0xDF26F436
-#define CHECKSUM_CIC6106 0x1FEA617A
+// hardware counters, for --perf
+#define STAT_PERF_COUNT 4
+#ifdef __linux__
+static const struct { const char *name; uint64_t config; } gPerfEvent[STAT_PERF_COUNT] = {
+	{ "cycles", PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache_misses", PERF_COUNT_HW_CACHE_MISSES },
+	{ "branch_misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+#endif
 
-static void gen_table(unsigned int crc_table[256])
+static struct
 {
-	unsigned int crc, poly;
-	int	i, j;
+	bool on;
+	enum statPhase phase; // being timed, or PHASE_COUNT for none
+	double phaseStart;
+	double time[PHASE_COUNT];
+	uint64_t count[STAT_COUNT];
+	int perfFd[STAT_PERF_COUNT]; // -1 if not available
+	uint64_t perfLast[STAT_PERF_COUNT];
+	uint64_t perf[PHASE_COUNT][STAT_PERF_COUNT];
+} gStats;
 
-	poly = 0xEDB88320;
-	for (i = 0; i < 256; i++) {
-		crc = i;
-		for (j = 8; j > 0; j--) {
-			if (crc & 1) crc = (crc >> 1) ^ poly;
-			else crc >>= 1;
-		}
-		crc_table[i] = crc;
-	}
+/* seconds since some fixed point in time */
+double stats_now(void)
+{
+	#ifndef _WIN32
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+	#else
+	return (double)clock() / CLOCKS_PER_SEC;
+	#endif
 }
 
-static unsigned int crc32(
-	unsigned int crc_table[256]
-	, unsigned char *data
-	, int len
-)
+void stat_add(enum statCount c, uint64_t n)
 {
-	unsigned int crc = ~0;
-	int i;
+	// scene walks run in parallel (see do_scenes())
+	if (gStats.on)
+		__atomic_fetch_add(&gStats.count[c], n, __ATOMIC_RELAXED);
+}
 
-	for (i = 0; i < len; i++) {
-		crc = (crc >> 8) ^ crc_table[(crc ^ data[i]) & 0xFF];
+#ifdef __linux__
+/* counts for this process and the threads it starts from now on
+ * returns false if the kernel won't allow it
+ * returns true otherwise
+ */
+static bool stats_perf_open(void)
+{
+	for (int i = 0; i < STAT_PERF_COUNT; ++i)
+	{
+		struct perf_event_attr attr;
+		
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = gPerfEvent[i].config;
+		attr.inherit = 1; // parallel_for() workers
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		
+		if ((gStats.perfFd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) < 0)
+		{
+			for (int k = 0; k < i; ++k)
+			{
+				close(gStats.perfFd[k]);
+				gStats.perfFd[k] = -1;
+			}
+			return false;
+		}
 	}
-
-	return ~crc;
+	
+	return true;
 }
+#endif
 
-static int N64GetCIC(unsigned int crc_table[256], unsigned char *data)
+static void stats_perf_read(uint64_t v[STAT_PERF_COUNT])
 {
-	switch (crc32(crc_table, &data[N64_HEADER_SIZE], N64_BC_SIZE)) {
-		case 0x6170A4A1: return 6101;
-		case 0x90BB6CB5: return 6102;
-		case 0x0B050EE0: return 6103;
-		case 0x98BC2C86: return 6105;
-		case 0xACC8580A: return 6106;
+	for (int i = 0; i < STAT_PERF_COUNT; ++i)
+	{
+		v[i] = 0;
+		#ifdef __linux__
+		if (gStats.perfFd[i] >= 0 && read(gStats.perfFd[i], &v[i], sizeof(v[i])) != sizeof(v[i]))
+			v[i] = 0;
+		#endif
 	}
-
-	return 0;
 }
 
-static int N64CalcCRC(
-	unsigned int crc_table[256]
-	, unsigned int *crc
-	, unsigned char *data
-)
+/* start collecting stats for a file, if --stats was given */
+void stats_begin(void)
 {
-	int bootcode, i;
-	unsigned int seed;
-	unsigned int t1, t2, t3;
-	unsigned int t4, t5, t6;
-	unsigned int r, d;
+	if (!gOpt.stats)
+		return;
+	
+	memset(&gStats, 0, sizeof(gStats));
+	gStats.on = true;
+	gStats.phase = PHASE_COUNT;
+	for (int i = 0; i < STAT_PERF_COUNT; ++i)
+		gStats.perfFd[i] = -1;
+	
+	if (!gOpt.perf)
+		return;
+	
+	#ifdef __linux__
+	if (!stats_perf_open())
+		fprintf(stderr, "warning: hardware counters are not available (see perf_event_paranoid)\n");
+	#else
+	fprintf(stderr, "warning: --perf is only supported on linux\n");
+	#endif
+}
 
-	switch ((bootcode = N64GetCIC(crc_table, data))) {
-		case 6101:
-		case 6102:
-			seed = CHECKSUM_CIC6102;
-			break;
-		case 6103:
-			seed = CHECKSUM_CIC6103;
-			break;
-		case 6105:
-			seed = CHECKSUM_CIC6105;
-			break;
-		case 6106:
-			seed = CHECKSUM_CIC6106;
-			break;
-		default:
-			return 1;
+/* end the phase being timed, if any, and start timing p */
+void stat_phase(enum statPhase p)
+{
+	uint64_t perf[STAT_PERF_COUNT];
+	double now;
+	
+	if (!gStats.on)
+		return;
+	
+	now = stats_now();
+	stats_perf_read(perf);
+	
+	if (gStats.phase != PHASE_COUNT)
+	{
+		gStats.time[gStats.phase] += now - gStats.phaseStart;
+		for (int i = 0; i < STAT_PERF_COUNT; ++i)
+			gStats.perf[gStats.phase][i] += perf[i] - gStats.perfLast[i];
 	}
+	
+	gStats.phase = p;
+	gStats.phaseStart = now;
+	memcpy(gStats.perfLast, perf, sizeof(perf));
+}
 
-	t1 = t2 = t3 = t4 = t5 = t6 = seed;
-
-	i = CHECKSUM_START;
-	while (i < (CHECKSUM_START + CHECKSUM_LENGTH)) {
-		d = BYTES2LONG(&data[i]);
-		if ((t6 + d) < t6)
-			t4++;
-		t6 += d;
-		t3 ^= d;
-		r = ROL(d, (d & 0x1F));
-		t5 += r;
-		if (t2 > d)
-			t2 ^= r;
-		else
-			t2 ^= t6 ^ d;
-
-		if (bootcode == 6105)
-			t1 += BYTES2LONG(&data[N64_HEADER_SIZE + 0x0710 + (i & 0xFF)]) ^ d;
+static void json_string(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; ++s)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(fp, "\\u%04x", *s);
 		else
-			t1 += t5 ^ d;
-
-		i += 4;
-	}
-	if (bootcode == 6103) {
-		crc[0] = (t6 ^ t4) + t3;
-		crc[1] = (t5 ^ t2) + t1;
-	}
-	else if (bootcode == 6106) {
-		crc[0] = (t6 * t4) + t3;
-		crc[1] = (t5 * t2) + t1;
-	}
-	else {
-		crc[0] = t6 ^ t4 ^ t3;
-		crc[1] = t5 ^ t2 ^ t1;
+			fputc(*s, fp);
 	}
-
-	return 0;
+	fputc('"', fp);
 }
 
-/* recalculate rom crc */
-void n64crc(void *rom)
+/* stop collecting and append a line of json describing the file fn
+ * to the --stats file (stderr if there isn't one, stdout for -)
+ */
+void stats_report(const char *fn)
 {
-	unsigned int crc_table[256];
-	unsigned char CRC1[4];
-	unsigned char CRC2[4];
-	unsigned int crc[2];
-	unsigned char *rom8 = rom;
+	static char buf[0x10000];
+	const char *out = gOpt.statsFn;
+	double total = 0;
+	FILE *fp = stderr;
 	
-	assert(rom);
+	if (!gStats.on)
+		return;
 	
-	gen_table(crc_table);
-
-	if (!N64CalcCRC(crc_table, crc, rom))
+	stat_phase(PHASE_COUNT);
+	gStats.on = false;
+	
+	if (out && !strcmp(out, "-"))
+		fp = stdout;
+	else if (out && !(fp = fopen(out, "a")))
+		fprintf(stderr, "failed to open stats file '%s'\n", out);
+	else if (out)
+		// one write per line, so batch jobs appending at once don't interleave
+		setvbuf(fp, buf, _IOFBF, sizeof(buf));
+	
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		total += gStats.time[i];
+	
+	if (fp)
 	{
-		unsigned int kk1 = crc[0];
-		unsigned int kk2 = crc[1];
-		int i;
-		
-		for (i = 0; i < 4; ++i)
+		fprintf(fp, "{\"file\":");
+		json_string(fp, fn);
+		fprintf(fp, ",\"ms\":%.3f,\"phases\":{", total * 1e3);
+		for (int i = 0; i < PHASE_COUNT; ++i)
 		{
-			CRC1[i] = (kk1 >> (24-8*i))&0xFF;
-			CRC2[i] = (kk2 >> (24-8*i))&0xFF;
+			fprintf(fp, "%s\"%s\":{\"ms\":%.3f", i ? "," : "", gPhaseName[i], gStats.time[i] * 1e3);
+			#ifdef __linux__
+			for (int k = 0; gStats.perfFd[0] >= 0 && k < STAT_PERF_COUNT; ++k)
+				fprintf(fp, ",\"%s\":%" PRIu64, gPerfEvent[k].name, gStats.perf[i][k]);
+			#endif
+			fprintf(fp, "}");
 		}
+		fprintf(fp, "},\"counts\":{");
+		for (int i = 0; i < STAT_COUNT; ++i)
+			fprintf(fp, "%s\"%s\":%" PRIu64, i ? "," : "", gStatName[i], gStats.count[i]);
+		fprintf(fp, "}}\n");
 		
-		for (i = 0; i < 4; ++i)
-			*(rom8 + N64_CRC1 + i) = CRC1[i];
-		
-		for (i = 0; i < 4; ++i)
-			*(rom8 + N64_CRC2 + i) = CRC2[i];
+		if (fp == stdout || fp == stderr)
+			fflush(fp);
+		else
+			fclose(fp);
 	}
+	
+	#ifdef __linux__
+	for (int i = 0; i < STAT_PERF_COUNT; ++i)
+		if (gStats.perfFd[i] >= 0)
+			close(gStats.perfFd[i]);
+	#endif
 }
 
 //
 //
-// end crc copy-pasta
+// dirty range tracking
 //
 //
 
-/* minimal file loader
- * returns 0 on failure
- * returns pointer to loaded file on success
+/* every write to the rom goes through this, so the byte ranges
+ * that were modified are known when it is time to emit a patch
  */
-void *loadfile(const char *fn, size_t *sz)
+static struct
 {
-	FILE *fp;
-	void *dat;
-	
-	/* rudimentary error checking returns 0 on any error */
-	if (
-		!fn
-		|| !sz
-		|| !(fp = fopen(fn, "rb"))
-		|| fseek(fp, 0, SEEK_END)
-		|| !(*sz = ftell(fp))
-		|| fseek(fp, 0, SEEK_SET)
-		|| !(dat = malloc(*sz))
-		|| fread(dat, 1, *sz, fp) != *sz
-		|| fclose(fp)
-	)
-		return 0;
-	
-	return dat;
-}
+	const uint8_t *base;
+	size_t size;
+	struct dirtyRange { size_t start, end; } *ranges;
+	int num;
+	int cap;
+} gDirty;
 
-/* minimal file writer
- * returns 0 on failure
- * returns non-zero on success
- */
-int savefile(const char *fn, const void *dat, const size_t sz)
+#ifndef _WIN32
+// scene walks run in parallel (see do_scenes())
+static pthread_mutex_t gDirtyLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* start tracking writes to the buffer base[0 .. size) */
+void dirty_begin(const void *base, size_t size)
 {
-	FILE *fp;
-	
-	/* rudimentary error checking returns 0 on any error */
-	if (
-		!fn
-		|| !sz
-		|| !dat
-		|| !(fp = fopen(fn, "wb"))
-		|| fwrite(dat, 1, sz, fp) != sz
-		|| fclose(fp)
-	)
-		return 0;
-	
-	return 1;
+	free(gDirty.ranges);
+	memset(&gDirty, 0, sizeof(gDirty));
+	gDirty.base = base;
+	gDirty.size = size;
 }
 
-uint32_t BEu32(const void *src)
+static void dirty_add(size_t start, size_t len)
 {
-	const uint8_t *b = src;
+	struct dirtyRange *last;
 	
-	return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+	// writes tend to be sequential, so try extending the newest range
+	last = gDirty.num ? &gDirty.ranges[gDirty.num - 1] : 0;
+	if (last && start <= last->end && start + len >= last->start)
+	{
+		if (start < last->start)
+			last->start = start;
+		if (start + len > last->end)
+			last->end = start + len;
+		return;
+	}
+	
+	if (gDirty.num == gDirty.cap)
+	{
+		struct dirtyRange *ranges;
+		int cap = gDirty.cap ? gDirty.cap * 2 : 256;
+		
+		if (!(ranges = realloc(gDirty.ranges, cap * sizeof(*ranges))))
+		{
+			fprintf(stderr, "dirty_mark: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		gDirty.ranges = ranges;
+		gDirty.cap = cap;
+	}
+	
+	gDirty.ranges[gDirty.num].start = start;
+	gDirty.ranges[gDirty.num].end = start + len;
+	gDirty.num += 1;
 }
 
-void wBEu32(void *dst, uint32_t v)
+/* record that len bytes at dst were modified */
+void dirty_mark(const void *dst, size_t len)
 {
-	uint8_t *b = dst;
+	const uint8_t *b = dst;
 	
-	b[0] = v >> 24;
-	b[1] = v >> 16;
-	b[2] = v >>  8;
-	b[3] = v;
+	if (!gDirty.base || !len || b < gDirty.base || b >= gDirty.base + gDirty.size)
+		return;
+	
+	stat_add(STAT_BYTES_WRITTEN, len);
+	
+	#ifndef _WIN32
+	pthread_mutex_lock(&gDirtyLock);
+	dirty_add(b - gDirty.base, len);
+	pthread_mutex_unlock(&gDirtyLock);
+	#else
+	dirty_add(b - gDirty.base, len);
+	#endif
 }
 
-void wBEu16(void *dst, uint16_t v)
+static int dirty_cmp(const void *a, const void *b)
 {
-	uint8_t *b = dst;
+	const struct dirtyRange *x = a;
+	const struct dirtyRange *y = b;
 	
-	b[0] = v >> 8;
-	b[1] = v;
+	return (x->start > y->start) - (x->start < y->start);
 }
 
-void dma_file_add(uint8_t *rom, uint32_t start, uint32_t end)
+/* sort the recorded ranges and merge overlapping or adjacent ones */
+void dirty_finish(void)
 {
-	uint8_t *dmaStart = rom + OOT_DMADATA_START;
-	uint8_t *dmaEnd = rom + OOT_DMADATA_END;
-	const int dmaStride = 0x10;
-	const uint8_t blank[0x10] = { 0 };
+	int i, n;
 	
-	for (rom = dmaStart; rom < dmaEnd; rom += dmaStride)
+	if (!gDirty.num)
+		return;
+	
+	qsort(gDirty.ranges, gDirty.num, sizeof(*gDirty.ranges), dirty_cmp);
+	
+	for (i = 1, n = 0; i < gDirty.num; ++i)
 	{
-		if (!memcmp(rom, blank, dmaStride))
+		struct dirtyRange *last = &gDirty.ranges[n];
+		struct dirtyRange *r = &gDirty.ranges[i];
+		
+		if (r->start <= last->end)
 		{
-			wBEu32(rom, start);
-			wBEu32(rom + 4, end);
-			wBEu32(rom + 8, start);
-			fprintf(stderr, "added file %08x %08x to dmadata\n", start, end);
-			return;
+			if (r->end > last->end)
+				last->end = r->end;
 		}
+		else
+			gDirty.ranges[++n] = *r;
 	}
+	gDirty.num = n + 1;
 }
 
-bool dma_file_exists(uint8_t *rom, uint32_t start, uint32_t end, const char *type, int index)
+/* returns true if any byte of [start, end) was modified
+ * (the ranges must have been merged by dirty_finish())
+ */
+bool dirty_overlaps(size_t start, size_t end)
 {
-	uint8_t *oRom = rom;
-	uint8_t *dmaStart = rom + OOT_DMADATA_START;
-	uint8_t *dmaEnd = rom + OOT_DMADATA_END;
-	const int dmaStride = 0x10;
+	int lo = 0;
+	int hi = gDirty.num;
 	
-	for (rom = dmaStart; rom < dmaEnd; rom += dmaStride)
+	// first range ending after start
+	while (lo < hi)
 	{
-		if (BEu32(rom) == start)
-		{
-			if (BEu32(rom + 4) != end)
-			{
-				/*
-				fprintf(stderr
-					, "%s %d %08x %08x error: dmadata has different size (%08x %08x)\n"
-					, type, index
-					, start, end
-					, start, BEu32(rom + 4)
-				);
-				*/
-				
-				// update existing dmadata entry
-				fprintf(stderr, "updated file %08x %08x in dmadata\n", start, end);
-				wBEu32(rom + 4, end);
-				return true;
-				
-				return false;
+		int mid = (lo + hi) / 2;
+		
+		if (gDirty.ranges[mid].end <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo < gDirty.num && gDirty.ranges[lo].start < end;
+}
+
+/* write helpers; each one skips the write entirely if the
+ * destination already holds the desired bytes, so unchanged
+ * data neither shows up in patches nor dirties mapped pages
+ */
+void rom_memcpy(void *dst, const void *src, size_t n)
+{
+	if (!memcmp(dst, src, n))
+		return;
+	
+	memcpy(dst, src, n);
+	dirty_mark(dst, n);
+}
+
+void rom_memmove(void *dst, const void *src, size_t n)
+{
+	if (!memcmp(dst, src, n))
+		return;
+	
+	memmove(dst, src, n);
+	dirty_mark(dst, n);
+}
+
+void rom_memset(void *dst, int v, size_t n)
+{
+	uint8_t *b = dst;
+	size_t i;
+	
+	for (i = 0; i < n && b[i] == (uint8_t)v; ++i)
+		;
+	if (i == n)
+		return;
+	
+	memset(b + i, v, n - i);
+	dirty_mark(b + i, n - i);
+}
+
+void wU8(void *dst, uint8_t v)
+{
+	uint8_t *b = dst;
+	
+	if (*b == v)
+		return;
+	
+	*b = v;
+	dirty_mark(b, 1);
+}
+
+//
+//
+// crc32
+//
+//
+
+/* slice-by-8 lookup tables, built once by crc32_pick() */
+static uint32_t gCrc32Table[8][256];
+
+static void crc32_init(void)
+{
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		
+		for (int j = 0; j < 8; ++j)
+			crc = (crc >> 1) ^ (-(crc & 1) & 0xEDB88320);
+		
+		gCrc32Table[0][i] = crc;
+	}
+	
+	for (int k = 1; k < 8; ++k)
+		for (int i = 0; i < 256; ++i)
+		{
+			uint32_t prev = gCrc32Table[k - 1][i];
+			
+			gCrc32Table[k][i] = (prev >> 8) ^ gCrc32Table[0][prev & 0xff];
+		}
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t *b, size_t len)
+{
+	uint32_t (*t)[256] = gCrc32Table;
+	
+	for (; len >= 8; len -= 8, b += 8)
+	{
+		uint32_t lo = crc ^ (b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24);
+		
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+			^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][b[4]] ^ t[2][b[5]] ^ t[1][b[6]] ^ t[0][b[7]]
+		;
+	}
+	
+	for (; len; --len)
+		crc = (crc >> 8) ^ t[0][(crc ^ *b++) & 0xff];
+	
+	return crc;
+}
+
+#if defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32_HAVE_ARMV8 1
+
+/* armv8 has instructions for this exact polynomial */
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(uint32_t crc, const uint8_t *b, size_t len)
+{
+	for (; len && ((uintptr_t)b & 7); --len)
+		crc = __crc32b(crc, *b++);
+	
+	for (; len >= 8; len -= 8, b += 8)
+	{
+		uint64_t v;
+		
+		memcpy(&v, b, sizeof(v));
+		crc = __crc32d(crc, v);
+	}
+	
+	for (; len; --len)
+		crc = __crc32b(crc, *b++);
+	
+	return crc;
+}
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL 1
+
+/* x86 has no instruction for this polynomial (the sse4.2 one is
+ * crc32c), but carry-less multiplication can fold 64 bytes at a time
+ * down to 16, then Barrett-reduce those to the crc; the constants are
+ * powers of x modulo the (bit-reflected) polynomial, as in Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"
+ * paper; whatever is past the last 16-byte block goes to slice-by-8
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *b, size_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4;
+	
+	if (len < 64)
+		return crc32_slice8(crc, b, len);
+	
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)b), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i *)(b + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(b + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(b + 0x30));
+	b += 64;
+	len -= 64;
+	
+	// fold four blocks at a time
+	for (; len >= 64; len -= 64, b += 64)
+	{
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), _mm_clmulepi64_si128(x1, k1k2, 0x11)), _mm_loadu_si128((const __m128i *)b));
+		x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), _mm_clmulepi64_si128(x2, k1k2, 0x11)), _mm_loadu_si128((const __m128i *)(b + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), _mm_clmulepi64_si128(x3, k1k2, 0x11)), _mm_loadu_si128((const __m128i *)(b + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), _mm_clmulepi64_si128(x4, k1k2, 0x11)), _mm_loadu_si128((const __m128i *)(b + 0x30)));
+	}
+	
+	// into one block, then the rest of the 16-byte blocks
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+	for (; len >= 16; len -= 16, b += 16)
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), _mm_loadu_si128((const __m128i *)b));
+	
+	// 128 bits to 64
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00), _mm_srli_si128(x1, 4));
+	
+	// Barrett reduction to 32
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), poly, 0x00);
+	crc = _mm_extract_epi32(_mm_xor_si128(x1, x2), 1);
+	
+	return crc32_slice8(crc, b, len);
+}
+#endif
+
+/* the fastest kernel this cpu has; only ever set once the tables it
+ * needs are complete, by crc32_pick()
+ */
+static uint32_t (*gCrc32Kernel)(uint32_t crc, const uint8_t *b, size_t len);
+
+static void crc32_pick(void)
+{
+	uint32_t (*kernel)(uint32_t, const uint8_t *, size_t) = crc32_slice8;
+	
+	#ifdef CRC32_HAVE_ARMV8
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+	{
+		gCrc32Kernel = crc32_armv8;
+		return;
+	}
+	#endif
+	
+	// slice-by-8 also does the tail of the pclmul kernel
+	crc32_init();
+	
+	#ifdef CRC32_HAVE_PCLMUL
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+		kernel = crc32_pclmul;
+	#endif
+	
+	gCrc32Kernel = kernel;
+}
+
+/* crc32 (the zlib/ieee 802.3 flavor) of len bytes of data
+ * pass 0 as crc to start, or a previous return value to continue
+ * safe to call from several threads at once, the first call included
+ */
+uint32_t crc32(uint32_t crc, const void *data, size_t len)
+{
+	#ifndef _WIN32
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	
+	pthread_once(&once, crc32_pick);
+	#else
+	// parallel_for() is serial on windows
+	if (!gCrc32Kernel)
+		crc32_pick();
+	#endif
+	
+	return ~gCrc32Kernel(~crc, data, len);
+}
+
+//
+//
+// hash64
+//
+//
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+#define ROL64(i, b) (((i) << (b)) | ((i) >> (64 - (b))))
+
+static uint64_t LEu64(const uint8_t *b)
+{
+	uint64_t v = 0;
+	
+	for (int i = 7; i >= 0; --i)
+		v = (v << 8) | b[i];
+	
+	return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t v)
+{
+	acc += v * XXH_P2;
+	acc = ROL64(acc, 31);
+	return acc * XXH_P1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t v)
+{
+	acc ^= xxh64_round(0, v);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+/* fast non-cryptographic 64-bit content hash (xxh64),
+ * for telling whether files or blocks have changed
+ */
+uint64_t hash64(const void *data, size_t len)
+{
+	const uint8_t *b = data;
+	const uint8_t *end = b + len;
+	uint64_t h;
+	
+	if (len >= 32)
+	{
+		uint64_t v1 = XXH_P1 + XXH_P2;
+		uint64_t v2 = XXH_P2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -XXH_P1;
+		
+		for (; end - b >= 32; b += 32)
+		{
+			v1 = xxh64_round(v1, LEu64(b));
+			v2 = xxh64_round(v2, LEu64(b + 8));
+			v3 = xxh64_round(v3, LEu64(b + 16));
+			v4 = xxh64_round(v4, LEu64(b + 24));
+		}
+		
+		h = ROL64(v1, 1) + ROL64(v2, 7) + ROL64(v3, 12) + ROL64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	}
+	else
+		h = XXH_P5;
+	
+	h += len;
+	
+	for (; end - b >= 8; b += 8)
+	{
+		h ^= xxh64_round(0, LEu64(b));
+		h = ROL64(h, 27) * XXH_P1 + XXH_P4;
+	}
+	
+	if (end - b >= 4)
+	{
+		h ^= (uint64_t)(b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24) * XXH_P1;
+		h = ROL64(h, 23) * XXH_P2 + XXH_P3;
+		b += 4;
+	}
+	
+	for (; b < end; ++b)
+	{
+		h ^= *b * XXH_P5;
+		h = ROL64(h, 11) * XXH_P1;
+	}
+	
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	
+	return h;
+}
+
+//
+//
+// threads
+//
+//
+
+#ifndef _WIN32
+struct parallelFor
+{
+	void (*fn)(void *ctx, int i);
+	void *ctx;
+	int num;
+	int next;
+	pthread_mutex_t lock;
+};
+
+static void *parallel_for_worker(void *arg)
+{
+	struct parallelFor *p = arg;
+	
+	for (;;)
+	{
+		int i;
+		
+		pthread_mutex_lock(&p->lock);
+		i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		
+		if (i >= p->num)
+			break;
+		
+		p->fn(p->ctx, i);
+	}
+	
+	return 0;
+}
+#endif
+
+/* number of threads worth starting */
+int num_cpus(void)
+{
+	#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	if (n > 1)
+		return n > 64 ? 64 : n;
+	#endif
+	
+	return 1;
+}
+
+/* calls fn(ctx, i) for every i in [0, num) across all cores,
+ * in no particular order; returns once every call has returned
+ */
+void parallel_for(int num, void (*fn)(void *ctx, int i), void *ctx)
+{
+	#ifndef _WIN32
+	struct parallelFor p = { fn, ctx, num, 0, PTHREAD_MUTEX_INITIALIZER };
+	pthread_t thread[64];
+	int nthreads = num_cpus();
+	int started = 0;
+	
+	if (nthreads > num)
+		nthreads = num;
+	
+	// the calling thread works too
+	while (started < nthreads - 1
+		&& !pthread_create(&thread[started], 0, parallel_for_worker, &p)
+	)
+		++started;
+	
+	parallel_for_worker(&p);
+	
+	while (started--)
+		pthread_join(thread[started], 0);
+	#else
+	for (int i = 0; i < num; ++i)
+		fn(ctx, i);
+	#endif
+}
+
+//
+//
+// crc copy-pasta
+//
+//
+/* snesrc - SNES Recompiler
+ *
+ * Mar 23, 2010: addition by spinout to actually fix CRC if it is incorrect
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2005 Parasyte
+ *
+ * Based on uCON64's N64 checksum algorithm by Andreas Sterbenz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <assert.h>
+
+#define ROL(i, b) (((i) << (b)) | ((i) >> (32 - (b))))
+#define BYTES2LONG(b) ( (b)[0] << 24 | \
+                        (b)[1] << 16 | \
+                        (b)[2] <<  8 | \
+                        (b)[3] )
+
+#define N64_HEADER_SIZE  0x40
+#define N64_BC_SIZE      (0x1000 - N64_HEADER_SIZE)
+
+#define N64_CRC1         0x10
+#define N64_CRC2         0x14
+
+#define CHECKSUM_START   0x00001000
+#define CHECKSUM_LENGTH  0x00100000
+#define CHECKSUM_CIC6102 0xF8CA4DDC
+#define CHECKSUM_CIC6103 0xA3886759
+#define CHECKSUM_CIC6105 0xDF26F436
+#define CHECKSUM_CIC6106 0x1FEA617A
+
+static int N64GetCIC(unsigned char *data)
+{
+	switch (crc32(0, &data[N64_HEADER_SIZE], N64_BC_SIZE)) {
+		case 0x6170A4A1: return 6101;
+		case 0x90BB6CB5: return 6102;
+		case 0x0B050EE0: return 6103;
+		case 0x98BC2C86: return 6105;
+		case 0xACC8580A: return 6106;
+	}
+
+	return 0;
+}
+
+/* folds data[i .. end) into checksum state t[6] (t1 through t6) */
+static void N64CRCFold(
+	unsigned int t[6]
+	, int bootcode
+	, unsigned char *data
+	, int i
+	, int end
+)
+{
+	unsigned int t1 = t[0], t2 = t[1], t3 = t[2];
+	unsigned int t4 = t[3], t5 = t[4], t6 = t[5];
+	unsigned int r, d;
+
+	while (i < end) {
+		d = BYTES2LONG(&data[i]);
+		if ((t6 + d) < t6)
+			t4++;
+		t6 += d;
+		t3 ^= d;
+		r = ROL(d, (d & 0x1F));
+		t5 += r;
+		if (t2 > d)
+			t2 ^= r;
+		else
+			t2 ^= t6 ^ d;
+
+		if (bootcode == 6105)
+			t1 += BYTES2LONG(&data[N64_HEADER_SIZE + 0x0710 + (i & 0xFF)]) ^ d;
+		else
+			t1 += t5 ^ d;
+
+		i += 4;
+	}
+
+	t[0] = t1; t[1] = t2; t[2] = t3;
+	t[3] = t4; t[4] = t5; t[5] = t6;
+}
+
+/* derives the final crc pair from checksum state t[6] */
+static void N64CRCFinish(
+	unsigned int *crc
+	, const unsigned int t[6]
+	, int bootcode
+)
+{
+	unsigned int t1 = t[0], t2 = t[1], t3 = t[2];
+	unsigned int t4 = t[3], t5 = t[4], t6 = t[5];
+
+	if (bootcode == 6103) {
+		crc[0] = (t6 ^ t4) + t3;
+		crc[1] = (t5 ^ t2) + t1;
+	}
+	else if (bootcode == 6106) {
+		crc[0] = (t6 * t4) + t3;
+		crc[1] = (t5 * t2) + t1;
+	}
+	else {
+		crc[0] = t6 ^ t4 ^ t3;
+		crc[1] = t5 ^ t2 ^ t1;
+	}
+}
+
+static int N64CalcCRC(
+	unsigned int *crc
+	, unsigned char *data
+)
+{
+	int bootcode, i;
+	unsigned int seed;
+	unsigned int t[6];
+
+	switch ((bootcode = N64GetCIC(data))) {
+		case 6101:
+		case 6102:
+			seed = CHECKSUM_CIC6102;
+			break;
+		case 6103:
+			seed = CHECKSUM_CIC6103;
+			break;
+		case 6105:
+			seed = CHECKSUM_CIC6105;
+			break;
+		case 6106:
+			seed = CHECKSUM_CIC6106;
+			break;
+		default:
+			return 1;
+	}
+
+	for (i = 0; i < 6; ++i)
+		t[i] = seed;
+
+	N64CRCFold(t, bootcode, data, CHECKSUM_START, CHECKSUM_START + CHECKSUM_LENGTH);
+	N64CRCFinish(crc, t, bootcode);
+
+	return 0;
+}
+
+/* recalculate rom crc */
+void n64crc(void *rom)
+{
+	unsigned char CRC1[4];
+	unsigned char CRC2[4];
+	unsigned int crc[2];
+	unsigned char *rom8 = rom;
+	
+	assert(rom);
+
+	if (!N64CalcCRC(crc, rom))
+	{
+		unsigned int kk1 = crc[0];
+		unsigned int kk2 = crc[1];
+		int i;
+		
+		for (i = 0; i < 4; ++i)
+		{
+			CRC1[i] = (kk1 >> (24-8*i))&0xFF;
+			CRC2[i] = (kk2 >> (24-8*i))&0xFF;
+		}
+		
+		for (i = 0; i < 4; ++i)
+			*(rom8 + N64_CRC1 + i) = CRC1[i];
+		
+		for (i = 0; i < 4; ++i)
+			*(rom8 + N64_CRC2 + i) = CRC2[i];
+		
+		dirty_mark(rom8 + N64_CRC1, 8);
+	}
+}
+
+//
+//
+// end crc copy-pasta
+//
+//
+
+//
+//
+// multi-rom checksum
+//
+//
+
+#define CRC_LANES 16
+
+static uint32_t N64GetSeed(int bootcode)
+{
+	switch (bootcode) {
+		case 6101:
+		case 6102: return CHECKSUM_CIC6102;
+		case 6103: return CHECKSUM_CIC6103;
+		case 6105: return CHECKSUM_CIC6105;
+		case 6106: return CHECKSUM_CIC6106;
+	}
+	
+	return 0;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CRC_HAVE_LANES 1
+
+/* one lane per rom, CRC_VEC lanes to a vector (one avx2 register);
+ * the kernel below is built for avx2 and picked at run time, as
+ * without it the lanes are emulated in scalar code, which is slower
+ * than doing one rom at a time
+ */
+#define CRC_VEC 8
+typedef uint32_t crcLanes __attribute__((vector_size(CRC_VEC * 4)));
+typedef int32_t crcLanesSigned __attribute__((vector_size(CRC_VEC * 4)));
+
+/* a < b in every lane, all ones where true; avx2 only compares signed
+ * words, so the sign bits are flipped to compare them as signed
+ */
+#define CRC_LANES_LT(a, b) \
+	((crcLanes)((crcLanesSigned)((a) ^ 0x80000000) < (crcLanesSigned)((b) ^ 0x80000000)))
+
+typedef void crcLanesKernel(unsigned char *data[CRC_LANES], const int bootcode[CRC_LANES], unsigned int crc[CRC_LANES][2]);
+
+/* N64CalcCRC() for CRC_LANES roms at once; the fold is serial
+ * within a rom, but independent across roms, so each rom gets
+ * its own lane and the per-lane branches become masks
+ */
+static inline __attribute__((always_inline)) void N64CalcCRCLanes(
+	unsigned char *data[CRC_LANES]
+	, const int bootcode[CRC_LANES]
+	, unsigned int crc[CRC_LANES][2]
+)
+{
+	enum { BLOCK = 64 }; // words of each rom staged at a time
+	enum { VECS = CRC_LANES / CRC_VEC };
+	crcLanes t1[VECS], t2[VECS], t3[VECS], t4[VECS], t5[VECS], t6[VECS], is6105[VECS];
+	uint32_t block[BLOCK][CRC_LANES];
+	uint32_t key[BLOCK][CRC_LANES] = { { 0 } }; // 6105 only, repeats every 0x100 bytes
+	uint32_t tmp[CRC_LANES];
+	uint32_t out[6][CRC_LANES];
+	
+	for (int l = 0; l < CRC_LANES; ++l)
+		tmp[l] = N64GetSeed(bootcode[l]);
+	memcpy(t1, tmp, sizeof(tmp));
+	memcpy(t2, tmp, sizeof(tmp));
+	memcpy(t3, tmp, sizeof(tmp));
+	memcpy(t4, tmp, sizeof(tmp));
+	memcpy(t5, tmp, sizeof(tmp));
+	memcpy(t6, tmp, sizeof(tmp));
+	
+	for (int l = 0; l < CRC_LANES; ++l)
+		tmp[l] = -(bootcode[l] == 6105);
+	memcpy(is6105, tmp, sizeof(tmp));
+	
+	for (int l = 0; l < CRC_LANES; ++l)
+		for (int w = 0; bootcode[l] == 6105 && w < BLOCK; ++w)
+			key[w][l] = BYTES2LONG(&data[l][N64_HEADER_SIZE + 0x0710 + w * 4]);
+	
+	for (int i = CHECKSUM_START; i < CHECKSUM_START + CHECKSUM_LENGTH; i += BLOCK * 4)
+	{
+		// gathering a word from every rom for each step is what
+		// makes this slow, so read a block of each rom in one go,
+		// transposing it so that each word's lanes are contiguous
+		for (int l = 0; l < CRC_LANES; ++l)
+			for (int w = 0; w < BLOCK; ++w)
+				block[w][l] = BYTES2LONG(&data[l][i + w * 4]);
+		
+		for (int w = 0; w < BLOCK; ++w)
+		{
+			for (int v = 0; v < VECS; ++v)
+			{
+				crcLanes d, k, r, s, m;
+				
+				memcpy(&d, &block[w][v * CRC_VEC], sizeof(d));
+				memcpy(&k, &key[w][v * CRC_VEC], sizeof(k)); // as i is a multiple of 0x100
+				
+				t4[v] -= CRC_LANES_LT(t6[v] + d, t6[v]); // true lanes are all ones (-1)
+				t6[v] += d;
+				t3[v] ^= d;
+				s = d & 0x1F;
+				r = (d << s) | (d >> ((32 - s) & 0x1F));
+				t5[v] += r;
+				m = CRC_LANES_LT(d, t2[v]);
+				t2[v] ^= (r & m) | ((t6[v] ^ d) & ~m);
+				t1[v] += ((k ^ d) & is6105[v]) | ((t5[v] ^ d) & ~is6105[v]);
+			}
+		}
+	}
+	
+	memcpy(out[0], t1, sizeof(*out));
+	memcpy(out[1], t2, sizeof(*out));
+	memcpy(out[2], t3, sizeof(*out));
+	memcpy(out[3], t4, sizeof(*out));
+	memcpy(out[4], t5, sizeof(*out));
+	memcpy(out[5], t6, sizeof(*out));
+	for (int l = 0; l < CRC_LANES; ++l)
+	{
+		const uint32_t u1 = out[0][l], u2 = out[1][l], u3 = out[2][l];
+		const uint32_t u4 = out[3][l], u5 = out[4][l], u6 = out[5][l];
+		
+		if (bootcode[l] == 6103) {
+			crc[l][0] = (u6 ^ u4) + u3;
+			crc[l][1] = (u5 ^ u2) + u1;
+		}
+		else if (bootcode[l] == 6106) {
+			crc[l][0] = (u6 * u4) + u3;
+			crc[l][1] = (u5 * u2) + u1;
+		}
+		else {
+			crc[l][0] = u6 ^ u4 ^ u3;
+			crc[l][1] = u5 ^ u2 ^ u1;
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static void N64CalcCRCLanesAvx2(unsigned char *data[CRC_LANES], const int bootcode[CRC_LANES], unsigned int crc[CRC_LANES][2])
+{
+	N64CalcCRCLanes(data, bootcode, crc);
+}
+
+/* returns the lane kernel this cpu runs, or 0 if it has none */
+static crcLanesKernel *n64crc_lanes_pick(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return N64CalcCRCLanesAvx2;
+	return 0;
+}
+#endif
+
+/* recalculate the crc of count roms, CRC_LANES at a time where the
+ * cpu has wide enough vectors, or else one at a time; results are
+ * identical to calling n64crc() on each rom, and roms with an
+ * unrecognized cic are likewise left untouched
+ */
+void n64crc_batch(void *roms[], int count)
+{
+	#ifdef CRC_HAVE_LANES
+	crcLanesKernel *kernel = n64crc_lanes_pick();
+	
+	while (kernel && count > 0)
+	{
+		unsigned char *data[CRC_LANES];
+		unsigned int crc[CRC_LANES][2];
+		int bootcode[CRC_LANES];
+		int n = 0;
+		
+		// fill the lanes with roms that have a known cic
+		for (; count && n < CRC_LANES; --count, ++roms)
+		{
+			if ((bootcode[n] = N64GetCIC(*roms)))
+				data[n++] = *roms;
+		}
+		
+		if (!n)
+			break;
+		
+		// idle lanes redo the first rom; their results are discarded
+		for (int l = n; l < CRC_LANES; ++l)
+		{
+			data[l] = data[0];
+			bootcode[l] = bootcode[0];
+		}
+		
+		kernel(data, bootcode, crc);
+		
+		for (int l = 0; l < n; ++l)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				data[l][N64_CRC1 + i] = crc[l][0] >> (24 - 8 * i);
+				data[l][N64_CRC2 + i] = crc[l][1] >> (24 - 8 * i);
+			}
+			dirty_mark(data[l] + N64_CRC1, 8);
+		}
+	}
+	#endif
+	
+	// no lanes, or no lanes worth using
+	for (int i = 0; i < count; ++i)
+		n64crc(roms[i]);
+}
+
+/* stdin and stdout are read and written this many bytes at a time */
+#define STREAM_CHUNK 0x100000
+
+/* "-" as a file name means stdin or stdout */
+static bool is_stream(const char *fn)
+{
+	return fn && !strcmp(fn, "-");
+}
+
+/* does fn end in ext (lowercase), ignoring case */
+static bool has_ext(const char *fn, const char *ext)
+{
+	size_t a = strlen(fn);
+	size_t b = strlen(ext);
+	
+	if (a < b)
+		return false;
+	
+	for (fn += a - b; *ext; ++fn, ++ext)
+		if (tolower((unsigned char)*fn) != *ext)
+			return false;
+	
+	return true;
+}
+
+/* reads all of fp, a chunk at a time, for inputs that can't seek
+ * returns 0 on failure
+ * returns pointer to the data on success
+ */
+static void *loadstream(FILE *fp, size_t *sz)
+{
+	uint8_t *dat = 0;
+	size_t cap = 0;
+	size_t got;
+	
+	#ifdef _WIN32
+	_setmode(_fileno(fp), _O_BINARY);
+	#endif
+	
+	for (*sz = 0; ; *sz += got)
+	{
+		if (cap - *sz < STREAM_CHUNK)
+		{
+			uint8_t *more = realloc(dat, cap ? cap * 2 : STREAM_CHUNK * 8);
+			
+			if (!more)
+			{
+				free(dat);
+				return 0;
+			}
+			dat = more;
+			cap = cap ? cap * 2 : STREAM_CHUNK * 8;
+		}
+		
+		if (!(got = fread(dat + *sz, 1, STREAM_CHUNK, fp)))
+			break;
+	}
+	
+	if (ferror(fp) || !*sz)
+	{
+		free(dat);
+		return 0;
+	}
+	
+	return dat;
+}
+
+/* writes sz bytes to fp a chunk at a time, for outputs that can't seek
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+static int savestream(FILE *fp, const void *dat, size_t sz)
+{
+	const uint8_t *b = dat;
+	
+	#ifdef _WIN32
+	_setmode(_fileno(fp), _O_BINARY);
+	#endif
+	
+	for (size_t at = 0; at < sz; at += STREAM_CHUNK)
+	{
+		size_t n = sz - at < STREAM_CHUNK ? sz - at : STREAM_CHUNK;
+		
+		if (fwrite(b + at, 1, n, fp) != n)
+			return 0;
+	}
+	
+	return !fflush(fp);
+}
+
+/* minimal file loader
+ * returns 0 on failure
+ * returns pointer to loaded file on success
+ */
+void *loadfile(const char *fn, size_t *sz)
+{
+	FILE *fp;
+	void *dat;
+	
+	if (is_stream(fn))
+		return sz ? loadstream(stdin, sz) : 0;
+	
+	/* rudimentary error checking returns 0 on any error */
+	if (
+		!fn
+		|| !sz
+		|| !(fp = fopen(fn, "rb"))
+		|| fseek(fp, 0, SEEK_END)
+		|| !(*sz = ftell(fp))
+		|| fseek(fp, 0, SEEK_SET)
+		|| !(dat = malloc(*sz))
+		|| fread(dat, 1, *sz, fp) != *sz
+		|| fclose(fp)
+	)
+		return 0;
+	
+	return dat;
+}
+
+/* minimal file writer
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int savefile(const char *fn, const void *dat, const size_t sz)
+{
+	FILE *fp;
+	
+	if (is_stream(fn))
+		return sz && dat && savestream(stdout, dat, sz);
+	
+	/* rudimentary error checking returns 0 on any error */
+	if (
+		!fn
+		|| !sz
+		|| !dat
+		|| !(fp = fopen(fn, "wb"))
+		|| fwrite(dat, 1, sz, fp) != sz
+		|| fclose(fp)
+	)
+		return 0;
+	
+	return 1;
+}
+
+#ifndef _WIN32
+/* copies sz bytes from in to out, letting the kernel do it when it can
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+static int copyfile(int in, int out, size_t sz)
+{
+	char buf[1 << 16];
+	ssize_t n;
+	
+	#ifdef __linux__
+	while (sz)
+	{
+		if ((n = copy_file_range(in, 0, out, 0, sz, 0)) <= 0)
+			break;
+		sz -= n;
+	}
+	if (!sz)
+		return 1;
+	#endif
+	
+	// generic fallback
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n)
+			return 0;
+	
+	return n == 0;
+}
+
+/* returns true if paths a and b name the same file, including
+ * through different spellings, symlinks, and hard links
+ */
+bool same_file(const char *a, const char *b)
+{
+	struct stat sa;
+	struct stat sb;
+	
+	if (!strcmp(a, b))
+		return true;
+	
+	return !stat(a, &sa) && !stat(b, &sb)
+		&& sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino
+	;
+}
+
+/* memory-mapped file loader
+ * the file is mapped shared and read/write, so only the pages the
+ * fixes actually touch get faulted in, and only the ones that were
+ * modified get written back; if ofn is not fn, fn is first copied
+ * to ofn, and ofn is what gets mapped (fn is never modified); if
+ * ofn is 0, fn is mapped copy-on-write and never written back
+ * returns 0 on failure (so the caller can fall back to loadfile())
+ * returns pointer to mapped file on success
+ */
+void *mapfile(const char *fn, const char *ofn, size_t *sz)
+{
+	struct stat st;
+	void *dat = 0;
+	int fd = -1;
+	
+	if (!fn || !sz)
+		return 0;
+	
+	if (!ofn)
+	{
+		if ((fd = open(fn, O_RDONLY)) < 0)
+			return 0;
+	}
+	else if (!same_file(fn, ofn))
+	{
+		int in = open(fn, O_RDONLY);
+		
+		if (in < 0)
+			return 0;
+		
+		if (
+			fstat(in, &st)
+			|| (fd = open(ofn, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0
+			|| !copyfile(in, fd, st.st_size)
+		)
+		{
+			if (fd >= 0)
+				close(fd);
+			close(in);
+			return 0;
+		}
+		close(in);
+	}
+	else if ((fd = open(fn, O_RDWR)) < 0)
+		return 0;
+	
+	if (
+		!fstat(fd, &st)
+		&& (*sz = st.st_size)
+		&& (dat = mmap(0, *sz, PROT_READ | PROT_WRITE
+			, ofn ? MAP_SHARED : MAP_PRIVATE, fd, 0)) == MAP_FAILED
+	)
+		dat = 0;
+	
+	// the mapping holds its own reference to the file
+	close(fd);
+	
+	return dat;
+}
+
+/* unmaps a file mapped with mapfile(), truncating ofn to sz
+ * bytes if the fixes shrunk it (mappedSz is the original size)
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int unmapfile(const char *ofn, void *dat, size_t mappedSz, size_t sz)
+{
+	if (munmap(dat, mappedSz))
+		return 0;
+	
+	if (ofn && sz != mappedSz && truncate(ofn, sz))
+		return 0;
+	
+	return 1;
+}
+#endif
+
+#ifndef _WIN32
+/* with --low-mem, the part of a shared mapping that may be dropped
+ * from memory once a pass is done with it (writes are kept, because
+ * they are already in the page cache, so this only trims rss)
+ */
+static struct
+{
+	const uint8_t *base;
+	size_t size;
+	size_t page;
+} gRelease;
+
+void rom_release_begin(const void *base, size_t size)
+{
+	gRelease.base = base;
+	gRelease.size = size;
+	gRelease.page = sysconf(_SC_PAGESIZE);
+}
+
+void rom_release_end(void)
+{
+	gRelease.base = 0;
+}
+#endif
+
+/* done with len bytes at dat for now; drop the whole pages among them */
+void rom_release(const void *dat, size_t len)
+{
+	#if !defined(_WIN32) && defined(MADV_DONTNEED)
+	const uint8_t *b = dat;
+	uintptr_t start;
+	uintptr_t end;
+	
+	if (!gRelease.base || b < gRelease.base || b >= gRelease.base + gRelease.size)
+		return;
+	
+	if (len > (size_t)(gRelease.base + gRelease.size - b))
+		len = gRelease.base + gRelease.size - b;
+	
+	start = ((uintptr_t)b + gRelease.page - 1) & ~(uintptr_t)(gRelease.page - 1);
+	end = ((uintptr_t)b + len) & ~(uintptr_t)(gRelease.page - 1);
+	if (end > start)
+		madvise((void*)start, end - start, MADV_DONTNEED);
+	#else
+	(void)dat;
+	(void)len;
+	#endif
+}
+
+/* growable byte buffer */
+struct bytebuf
+{
+	uint8_t *dat;
+	size_t sz;
+	size_t cap;
+	bool oom;
+};
+
+static void bytebuf_put(struct bytebuf *b, const void *src, size_t n)
+{
+	if (b->sz + n > b->cap)
+	{
+		size_t cap = b->cap ? b->cap : 4096;
+		uint8_t *dat;
+		
+		while (cap < b->sz + n)
+			cap *= 2;
+		
+		if (!(dat = realloc(b->dat, cap)))
+		{
+			b->oom = true;
+			return;
+		}
+		b->dat = dat;
+		b->cap = cap;
+	}
+	
+	memcpy(b->dat + b->sz, src, n);
+	b->sz += n;
+}
+
+static void bytebuf_putLEu32(struct bytebuf *b, uint32_t v)
+{
+	const uint8_t le[4] = { v, v >> 8, v >> 16, v >> 24 };
+	
+	bytebuf_put(b, le, sizeof(le));
+}
+
+static void bps_number(struct bytebuf *b, uint64_t v)
+{
+	for (;;)
+	{
+		uint8_t x = v & 0x7f;
+		
+		v >>= 7;
+		if (!v)
+		{
+			x |= 0x80;
+			bytebuf_put(b, &x, 1);
+			break;
+		}
+		bytebuf_put(b, &x, 1);
+		v -= 1;
+	}
+}
+
+/* minimal BPS patch writer
+ * the target is described as source reads (bytes the fixes never
+ * touched) and target reads (the dirty ranges, carried in the patch);
+ * dirty_finish() must be called beforehand
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int savebps(const char *fn, const uint8_t *dat, size_t sz, size_t srcSz, uint32_t srcCrc)
+{
+	enum { SourceRead = 0, TargetRead = 1 };
+	struct bytebuf b = { 0 };
+	size_t pos = 0;
+	int rval;
+	
+	bytebuf_put(&b, "BPS1", 4);
+	bps_number(&b, srcSz);
+	bps_number(&b, sz);
+	bps_number(&b, 0); // no metadata
+	
+	for (int i = 0; i <= gDirty.num; ++i)
+	{
+		// the final iteration covers whatever follows the last range
+		size_t start = (i < gDirty.num) ? gDirty.ranges[i].start : sz;
+		size_t end = (i < gDirty.num) ? gDirty.ranges[i].end : sz;
+		size_t copyEnd;
+		
+		if (start > sz)
+			start = sz;
+		if (end > sz)
+			end = sz;
+		copyEnd = (start < srcSz) ? start : srcSz;
+		
+		if (pos < copyEnd)
+		{
+			bps_number(&b, ((uint64_t)(copyEnd - pos - 1) << 2) | SourceRead);
+			pos = copyEnd;
+		}
+		
+		if (pos < end)
+		{
+			bps_number(&b, ((uint64_t)(end - pos - 1) << 2) | TargetRead);
+			bytebuf_put(&b, dat + pos, end - pos);
+			pos = end;
+		}
+	}
+	
+	bytebuf_putLEu32(&b, srcCrc);
+	bytebuf_putLEu32(&b, crc32(0, dat, sz));
+	bytebuf_putLEu32(&b, crc32(0, b.dat, b.sz));
+	
+	rval = !b.oom && savefile(fn, b.dat, b.sz);
+	free(b.dat);
+	
+	return rval;
+}
+
+uint32_t BEu32(const void *src)
+{
+	const uint8_t *b = src;
+	
+	return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+void wBEu32(void *dst, uint32_t v)
+{
+	uint8_t *b = dst;
+	
+	if (BEu32(b) == v)
+		return;
+	
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >>  8;
+	b[3] = v;
+	dirty_mark(b, 4);
+}
+
+void wBEu16(void *dst, uint16_t v)
+{
+	uint8_t *b = dst;
+	
+	if (((b[0] << 8) | b[1]) == v)
+		return;
+	
+	b[0] = v >> 8;
+	b[1] = v;
+	dirty_mark(b, 2);
+}
+
+//
+//
+// resumable checksum
+//
+//
+
+#define CRC_CACHE_MAGIC  "ZBRFCRC1"
+#define CRC_BLOCK_SIZE   0x10000
+#define CRC_BLOCKS       (CHECKSUM_LENGTH / CRC_BLOCK_SIZE)
+
+/* sidecar file contents, stored big-endian */
+struct crcCache
+{
+	char magic[8];
+	uint32_t bootcode;
+	uint64_t bootHash; // hash64 of the bootcode
+	uint64_t blockHash[CRC_BLOCKS]; // hash64 of each block
+	uint32_t state[CRC_BLOCKS + 1][6]; // t1 .. t6 at each block start
+};
+
+static uint64_t BEu64(const uint8_t *b)
+{
+	return ((uint64_t)BEu32(b) << 32) | BEu32(b + 4);
+}
+
+static void wBEu64(uint8_t *b, uint64_t v)
+{
+	for (int i = 0; i < 8; ++i)
+		b[i] = v >> (56 - 8 * i);
+}
+
+static bool crc_cache_load(struct crcCache *c, const char *fn)
+{
+	const size_t sz = 8 + 4 + 8 + CRC_BLOCKS * 8 + (CRC_BLOCKS + 1) * 6 * 4;
+	size_t fileSz;
+	uint8_t *dat;
+	uint8_t *b;
+	
+	if (!(dat = loadfile(fn, &fileSz)))
+		return false;
+	
+	if (fileSz != sz || memcmp(dat, CRC_CACHE_MAGIC, 8))
+	{
+		free(dat);
+		return false;
+	}
+	
+	b = dat + 8;
+	c->bootcode = BEu32(b); b += 4;
+	c->bootHash = BEu64(b); b += 8;
+	for (int i = 0; i < CRC_BLOCKS; ++i, b += 8)
+		c->blockHash[i] = BEu64(b);
+	for (int i = 0; i <= CRC_BLOCKS; ++i)
+		for (int k = 0; k < 6; ++k, b += 4)
+			c->state[i][k] = BEu32(b);
+	
+	free(dat);
+	return true;
+}
+
+static bool crc_cache_save(const struct crcCache *c, const char *fn)
+{
+	uint8_t dat[8 + 4 + 8 + CRC_BLOCKS * 8 + (CRC_BLOCKS + 1) * 6 * 4];
+	uint8_t *b = dat + 8;
+	
+	memcpy(dat, CRC_CACHE_MAGIC, 8);
+	for (int i = 0; i < 4; ++i)
+		*b++ = c->bootcode >> (24 - 8 * i);
+	wBEu64(b, c->bootHash); b += 8;
+	for (int i = 0; i < CRC_BLOCKS; ++i, b += 8)
+		wBEu64(b, c->blockHash[i]);
+	for (int i = 0; i <= CRC_BLOCKS; ++i)
+		for (int k = 0; k < 6; ++k)
+			for (int j = 0; j < 4; ++j)
+				*b++ = c->state[i][k] >> (24 - 8 * j);
+	
+	return savefile(fn, dat, sizeof(dat));
+}
+
+/* n64crc(), but checkpointing the fold every CRC_BLOCK_SIZE bytes
+ * into the sidecar file cacheFn; on later runs, blocks whose hash
+ * still matches are skipped, and the fold resumes from the state
+ * saved before the first block that changed
+ */
+void n64crc_resume(void *rom, const char *cacheFn)
+{
+	unsigned char *data = rom;
+	struct crcCache c;
+	unsigned int crc[2];
+	int bootcode;
+	int first = 0;
+	
+	if (!(bootcode = N64GetCIC(data)))
+		return;
+	
+	if (
+		crc_cache_load(&c, cacheFn)
+		&& c.bootcode == (uint32_t)bootcode
+		&& c.bootHash == hash64(data + N64_HEADER_SIZE, N64_BC_SIZE)
+	)
+	{
+		while (first < CRC_BLOCKS
+			&& c.blockHash[first] == hash64(data + CHECKSUM_START + first * CRC_BLOCK_SIZE, CRC_BLOCK_SIZE)
+		)
+			++first;
+	}
+	else
+	{
+		memset(&c, 0, sizeof(c));
+		c.bootcode = bootcode;
+		c.bootHash = hash64(data + N64_HEADER_SIZE, N64_BC_SIZE);
+		for (int k = 0; k < 6; ++k)
+			c.state[0][k] = N64GetSeed(bootcode);
+	}
+	
+	if (first < CRC_BLOCKS)
+		fprintf(stderr, "checksum resumed at %08x\n", CHECKSUM_START + first * CRC_BLOCK_SIZE);
+	
+	for (int i = first; i < CRC_BLOCKS; ++i)
+	{
+		int start = CHECKSUM_START + i * CRC_BLOCK_SIZE;
+		
+		c.blockHash[i] = hash64(data + start, CRC_BLOCK_SIZE);
+		memcpy(c.state[i + 1], c.state[i], sizeof(c.state[i]));
+		N64CRCFold(c.state[i + 1], bootcode, data, start, start + CRC_BLOCK_SIZE);
+	}
+	
+	N64CRCFinish(crc, c.state[CRC_BLOCKS], bootcode);
+	wBEu32(data + N64_CRC1, crc[0]);
+	wBEu32(data + N64_CRC2, crc[1]);
+	
+	if (first < CRC_BLOCKS && !crc_cache_save(&c, cacheFn))
+		fprintf(stderr, "failed to write checksum cache '%s'\n", cacheFn);
+}
+
+//
+//
+// dmadata index
+//
+//
+
+#define DMA_STRIDE 0x10
+#define DMA_COUNT ((OOT_DMADATA_END - OOT_DMADATA_START) / DMA_STRIDE)
+
+/* dmadata is parsed once into memory, where entries are found by
+ * vrom start through a sorted index instead of by scanning the table;
+ * blank entries are queued in table order for dma_file_add() to use,
+ * and the entries that changed are written back by dma_commit()
+ */
+static struct
+{
+	struct dmaEntry
+	{
+		uint32_t start;
+		uint32_t end;
+		uint32_t pstart;
+		uint32_t pend;
+		bool dirty;
+	} entry[DMA_COUNT];
+	uint16_t byStart[DMA_COUNT]; // every entry, sorted by (start, index)
+	uint16_t blank[DMA_COUNT]; // blank entries, in table order
+	int numBlank;
+	int nextBlank;
+} gDma;
+
+static bool dma_is_blank(const struct dmaEntry *e)
+{
+	return !(e->start | e->end | e->pstart | e->pend);
+}
+
+static int dma_cmp(const void *a, const void *b)
+{
+	const int x = *(const uint16_t*)a;
+	const int y = *(const uint16_t*)b;
+	const uint32_t xs = gDma.entry[x].start;
+	const uint32_t ys = gDma.entry[y].start;
+	
+	if (xs != ys)
+		return (xs > ys) - (xs < ys);
+	
+	return x - y;
+}
+
+/* position among the first num items of gDma.byStart of the
+ * first entry whose (start, index) is not less than the one given
+ */
+static int dma_lower_bound(uint32_t start, int index, int num)
+{
+	int lo = 0;
+	int hi = num;
+	
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		const int i = gDma.byStart[mid];
+		const uint32_t s = gDma.entry[i].start;
+		
+		if (s < start || (s == start && i < index))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+/* parse dmadata into gDma */
+void dma_load(const uint8_t *rom)
+{
+	const uint8_t *b = rom + OOT_DMADATA_START;
+	
+	gDma.numBlank = 0;
+	gDma.nextBlank = 0;
+	
+	for (int i = 0; i < DMA_COUNT; ++i, b += DMA_STRIDE)
+	{
+		struct dmaEntry *e = &gDma.entry[i];
+		
+		e->start = BEu32(b);
+		e->end = BEu32(b + 4);
+		e->pstart = BEu32(b + 8);
+		e->pend = BEu32(b + 12);
+		e->dirty = false;
+		
+		gDma.byStart[i] = i;
+		if (dma_is_blank(e))
+			gDma.blank[gDma.numBlank++] = i;
+	}
+	
+	qsort(gDma.byStart, DMA_COUNT, sizeof(*gDma.byStart), dma_cmp);
+}
+
+/* write entries modified since dma_load() back to dmadata */
+void dma_commit(uint8_t *rom)
+{
+	uint8_t *b = rom + OOT_DMADATA_START;
+	
+	for (int i = 0; i < DMA_COUNT; ++i, b += DMA_STRIDE)
+	{
+		struct dmaEntry *e = &gDma.entry[i];
+		
+		if (!e->dirty)
+			continue;
+		
+		wBEu32(b, e->start);
+		wBEu32(b + 4, e->end);
+		wBEu32(b + 8, e->pstart);
+		wBEu32(b + 12, e->pend);
+		e->dirty = false;
+	}
+}
+
+/* index of the first entry (in table order) starting at start, or -1 */
+int dma_find(uint32_t start)
+{
+	int pos = dma_lower_bound(start, 0, DMA_COUNT);
+	
+	if (pos < DMA_COUNT && gDma.entry[gDma.byStart[pos]].start == start)
+		return gDma.byStart[pos];
+	
+	return -1;
+}
+
+/* change the vrom start of an entry, keeping the index sorted */
+static void dma_set_start(int i, uint32_t start)
+{
+	uint16_t *byStart = gDma.byStart;
+	int from = dma_lower_bound(gDma.entry[i].start, i, DMA_COUNT);
+	int to;
+	
+	memmove(byStart + from, byStart + from + 1, (DMA_COUNT - from - 1) * sizeof(*byStart));
+	gDma.entry[i].start = start;
+	to = dma_lower_bound(start, i, DMA_COUNT - 1);
+	memmove(byStart + to + 1, byStart + to, (DMA_COUNT - to - 1) * sizeof(*byStart));
+	byStart[to] = i;
+}
+
+void dma_file_add(uint8_t *rom, uint32_t start, uint32_t end)
+{
+	// first entry that is still blank, in table order
+	for (; gDma.nextBlank < gDma.numBlank; ++gDma.nextBlank)
+	{
+		const int i = gDma.blank[gDma.nextBlank];
+		struct dmaEntry *e = &gDma.entry[i];
+		
+		if (!dma_is_blank(e))
+			continue;
+		
+		dma_set_start(i, start);
+		e->end = end;
+		e->pstart = start;
+		e->dirty = true;
+		stat_add(STAT_DMA_ADDS, 1);
+		fprintf(stderr, "added file %08x %08x to dmadata\n", start, end);
+		return;
+	}
+	
+	(void)rom;
+}
+
+/* repoint the entry for the file at oldStart to [start, end) */
+void dma_file_move(uint32_t oldStart, uint32_t start, uint32_t end)
+{
+	int i = dma_find(oldStart);
+	
+	if (i < 0)
+		return;
+	
+	dma_set_start(i, start);
+	gDma.entry[i].end = end;
+	gDma.entry[i].pstart = start;
+	gDma.entry[i].pend = 0;
+	gDma.entry[i].dirty = true;
+	stat_add(STAT_DMA_UPDATES, 1);
+	fprintf(stderr, "moved file %08x to %08x %08x in dmadata\n", oldStart, start, end);
+}
+
+bool dma_file_exists(uint8_t *rom, uint32_t start, uint32_t end, const char *type, int index)
+{
+	int i = dma_find(start);
+	
+	stat_add(STAT_DMA_LOOKUPS, 1);
+	
+	if (i >= 0)
+	{
+		struct dmaEntry *e = &gDma.entry[i];
+		
+		if (e->end != end)
+		{
+			// update existing dmadata entry
+			fprintf(stderr, "updated file %08x %08x in dmadata\n", start, end);
+			e->end = end;
+			e->dirty = true;
+			stat_add(STAT_DMA_UPDATES, 1);
+		}
+		return true;
+	}
+	
+	// doesn't exist in dmadata: add it
+	dma_file_add(rom, start, end);
+	
+	//fprintf(stderr, "%s %d %08x %08x error: no dma entry exists\n", type, index, start, end);
+	return false;
+	
+	(void)type;
+	(void)index;
+}
+
+//
+//
+// rom space map
+//
+//
+
+enum romFileType { FILE_DMA, FILE_SCENE, FILE_TITLE, FILE_OBJECT, FILE_ACTOR, FILE_ROOM };
+static const char *const gFileTypeName[] = { "dma", "scene", "title", "object", "actor", "room" };
+
+/* rom offsets of the (start, end) pairs in every room file list
+ * the scene walk came across, so rooms can be repointed later
+ */
+static struct
+{
+	uint32_t *off;
+	int num;
+	int cap;
+} gRoomRefs;
+
+void room_ref_add(uint32_t off)
+{
+	if (gRoomRefs.num == gRoomRefs.cap)
+	{
+		uint32_t *ref;
+		int cap = gRoomRefs.cap ? gRoomRefs.cap * 2 : 256;
+		
+		if (!(ref = realloc(gRoomRefs.off, cap * sizeof(*ref))))
+		{
+			fprintf(stderr, "room_ref_add: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		gRoomRefs.off = ref;
+		gRoomRefs.cap = cap;
+	}
+	
+	gRoomRefs.off[gRoomRefs.num++] = off;
+}
+
+/* every file range known from dmadata and the scene, object,
+ * and actor tables, for finding overlapping or out-of-bounds files
+ */
+static struct
+{
+	struct romFile
+	{
+		uint32_t start;
+		uint32_t end;
+		uint16_t index;
+		uint8_t type;
+	} *file;
+	int num;
+	int cap;
+} gMap;
+
+static void map_add(uint32_t start, uint32_t end, enum romFileType type, int index)
+{
+	if (!start && !end)
+		return;
+	
+	if (gMap.num == gMap.cap)
+	{
+		struct romFile *file;
+		int cap = gMap.cap ? gMap.cap * 2 : 1024;
+		
+		if (!(file = realloc(gMap.file, cap * sizeof(*file))))
+		{
+			fprintf(stderr, "map_add: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		gMap.file = file;
+		gMap.cap = cap;
+	}
+	
+	gMap.file[gMap.num].start = start;
+	gMap.file[gMap.num].end = end;
+	gMap.file[gMap.num].type = type;
+	gMap.file[gMap.num].index = index;
+	gMap.num += 1;
+}
+
+static int map_cmp(const void *a, const void *b)
+{
+	const struct romFile *x = a;
+	const struct romFile *y = b;
+	
+	if (x->start != y->start)
+		return (x->start > y->start) - (x->start < y->start);
+	if (x->end != y->end)
+		return (x->end > y->end) - (x->end < y->end);
+	if (x->type != y->type)
+		return x->type - y->type;
+	return x->index - y->index;
+}
+
+/* collect every known file range, sorted by start then end
+ * (rooms are known only once the scene walk has recorded them)
+ */
+void map_build(const uint8_t *rom)
+{
+	gMap.num = 0;
+	
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		const struct dmaEntry *e = &gDma.entry[i];
+		
+		// pstart 0xffffffff marks a deleted file
+		if (e->pstart != 0xFFFFFFFF)
+			map_add(e->start, e->end, FILE_DMA, i);
+	}
+	
+	for (int i = 0; i < (OOT_SCENE_TABLE_END - OOT_SCENE_TABLE_START) / 0x14; ++i)
+	{
+		const uint8_t *b = rom + OOT_SCENE_TABLE_START + i * 0x14;
+		
+		map_add(BEu32(b), BEu32(b + 4), FILE_SCENE, i);
+		map_add(BEu32(b + 8), BEu32(b + 12), FILE_TITLE, i);
+	}
+	
+	for (int i = 0; i < (OOT_OBJECT_TABLE_END - OOT_OBJECT_TABLE_START) / 0x8; ++i)
+	{
+		const uint8_t *b = rom + OOT_OBJECT_TABLE_START + i * 0x8;
+		
+		map_add(BEu32(b), BEu32(b + 4), FILE_OBJECT, i);
+	}
+	
+	for (int i = 0; i < OOT_ACTOR_TABLE_LENGTH; ++i)
+	{
+		const uint8_t *b = rom + OOT_ACTOR_TABLE_START + i * 0x20;
+		
+		map_add(BEu32(b), BEu32(b + 4), FILE_ACTOR, i);
+	}
+	
+	for (int i = 0; i < gRoomRefs.num; ++i)
+	{
+		const uint8_t *b = rom + gRoomRefs.off[i];
+		
+		map_add(BEu32(b), BEu32(b + 4), FILE_ROOM, i);
+	}
+	
+	qsort(gMap.file, gMap.num, sizeof(*gMap.file), map_cmp);
+}
+
+/* report files that overlap one another or extend past the end
+ * of the rom; the same range listed by several tables is one file
+ * returns the number of problems found
+ */
+int map_check(size_t romSz)
+{
+	const struct romFile *last = 0; // the file reaching furthest so far
+	int problems = 0;
+	
+	for (int i = 0; i < gMap.num; ++i)
+	{
+		const struct romFile *f = &gMap.file[i];
+		
+		if (f->end < f->start || f->end > romSz)
+		{
+			fprintf(stderr, "warning: %s %d %08x %08x is out of bounds\n"
+				, gFileTypeName[f->type], f->index, f->start, f->end
+			);
+			++problems;
+			continue;
+		}
+		
+		if (last && f->start < last->end
+			&& !(f->start == last->start && f->end == last->end)
+		)
+		{
+			fprintf(stderr, "warning: %s %d %08x %08x overlaps %s %d %08x %08x\n"
+				, gFileTypeName[f->type], f->index, f->start, f->end
+				, gFileTypeName[last->type], last->index, last->start, last->end
+			);
+			++problems;
+		}
+		
+		if (!last || f->end > last->end)
+			last = f;
+	}
+	
+	return problems;
+}
+
+//
+//
+// free space allocator
+//
+//
+
+#define ALLOC_ALIGN 16 // dma transfers want 16-byte alignment
+
+/* unused rom space, as blocks sorted by (size, start) for best-fit;
+ * fed only by gaps between the files in gMap that are blank (all
+ * 0x00 or 0xff), and never by the fixed tables or patch targets;
+ * files whose dmadata entries were cleared are not free, as plenty
+ * of this mod's files have no dmadata entry to begin with;
+ * a best-fit lookup is a binary search, but inserting or removing a
+ * block shifts the ones after it, so those are O(n); a rom has tens
+ * of blocks and a run does a handful of allocations, where a sorted
+ * array beats a balanced tree
+ */
+static struct
+{
+	struct freeBlock { uint32_t start, end; } *block;
+	int num;
+	int cap;
+	bool ready; // built lazily, as most runs never need it
+} gFree;
+
+/* tables at hard-coded offsets, which nothing may be written over */
+static const uint32_t gFixedTable[][2] = { // ascending
+	{ OOT_DMADATA_START, OOT_DMADATA_END },
+	{ OOT_ACTOR_TABLE_START, OOT_ACTOR_TABLE_END },
+	{ OOT_OBJECT_TABLE_START, OOT_OBJECT_TABLE_END },
+	{ OOT_SCENE_TABLE_START, OOT_SCENE_TABLE_END },
+};
+
+static uint32_t align_up(uint32_t v)
+{
+	return (v + (ALLOC_ALIGN - 1)) & ~(ALLOC_ALIGN - 1);
+}
+
+/* position of the first block not smaller than (size, start) */
+static int alloc_lower_bound(uint32_t size, uint32_t start)
+{
+	int lo = 0;
+	int hi = gFree.num;
+	
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		const struct freeBlock *b = &gFree.block[mid];
+		const uint32_t sz = b->end - b->start;
+		
+		if (sz < size || (sz == size && b->start < start))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	return lo;
+}
+
+static void alloc_insert(uint32_t start, uint32_t end)
+{
+	int pos;
+	
+	start = align_up(start);
+	end &= ~(ALLOC_ALIGN - 1);
+	if (end <= start)
+		return;
+	
+	if (gFree.num == gFree.cap)
+	{
+		struct freeBlock *block;
+		int cap = gFree.cap ? gFree.cap * 2 : 64;
+		
+		if (!(block = realloc(gFree.block, cap * sizeof(*block))))
+		{
+			fprintf(stderr, "alloc_insert: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		gFree.block = block;
+		gFree.cap = cap;
+	}
+	
+	pos = alloc_lower_bound(end - start, start);
+	memmove(gFree.block + pos + 1, gFree.block + pos, (gFree.num - pos) * sizeof(*gFree.block));
+	gFree.block[pos].start = start;
+	gFree.block[pos].end = end;
+	gFree.num += 1;
+}
+
+static void alloc_remove(int pos)
+{
+	gFree.num -= 1;
+	memmove(gFree.block + pos, gFree.block + pos + 1, (gFree.num - pos) * sizeof(*gFree.block));
+}
+
+/* return [start, end) to the free space, merging it with neighbors */
+void alloc_release(uint32_t start, uint32_t end)
+{
+	for (int i = 0; i < gFree.num; )
+	{
+		const struct freeBlock b = gFree.block[i];
+		
+		if (b.end >= start && b.start <= end)
+		{
+			if (b.start < start)
+				start = b.start;
+			if (b.end > end)
+				end = b.end;
+			alloc_remove(i);
+			continue;
+		}
+		++i;
+	}
+	
+	alloc_insert(start, end);
+}
+
+static bool is_blank(const uint8_t *b, size_t sz)
+{
+	for (size_t i = 1; i < sz; ++i)
+		if (b[i] != b[0])
+			return false;
+	
+	return !sz || b[0] == 0x00 || b[0] == 0xFF;
+}
+
+/* is_blank() for the gap [start, end), checked a chunk at a time; with
+ * --low-mem each chunk is dropped from memory as soon as it is checked,
+ * because a gap can be most of the rom
+ */
+static bool gap_is_blank(const uint8_t *rom, uint32_t start, uint32_t end)
+{
+	const uint32_t chunk = 0x100000;
+	const uint8_t fill = rom[start];
+	
+	for (uint32_t pos = start; pos < end; pos += chunk)
+	{
+		uint32_t len = (end - pos < chunk) ? end - pos : chunk;
+		bool blank = rom[pos] == fill && is_blank(rom + pos, len);
+		
+		rom_release(rom + pos, len);
+		if (!blank)
+			return false;
+	}
+	
+	return true;
+}
+
+/* for alloc_add_gap(): where the reserved range [rStart, rEnd) ends
+ * if it covers start, or else where it cuts the gap short
+ */
+static void alloc_clip(uint32_t start, uint32_t rStart, uint32_t rEnd, uint32_t *next, uint32_t *skip)
+{
+	if (rStart <= start && rEnd > start)
+	{
+		if (rEnd > *skip)
+			*skip = rEnd;
+	}
+	else if (rStart > start && rStart < *next)
+		*next = rStart;
+}
+
+/* add the blank part of the gap [start, end) to the free space */
+static void alloc_add_gap(const uint8_t *rom, uint32_t start, uint32_t end)
+{
+	while (start < end)
+	{
+		uint32_t next = end;
+		uint32_t skip = 0;
+		
+		// find the reserved range covering start, or else the next one;
+		// code holds more tables than the fixed ones (entrances, ...),
+		// so none of it is free even where dmadata doesn't list it
+		alloc_clip(start, OOT_CODE_START, OOT_CODE_END, &next, &skip);
+		for (size_t i = 0; i < sizeof(gFixedTable) / sizeof(*gFixedTable); ++i)
+			alloc_clip(start, gFixedTable[i][0], gFixedTable[i][1], &next, &skip);
+		for (int i = 0; i < PATCH_COUNT; ++i)
+			alloc_clip(start, gPatchTarget[i].start, gPatchTarget[i].end, &next, &skip);
+		
+		if (skip)
+			next = (skip < end) ? skip : end;
+		else if (gap_is_blank(rom, start, next))
+			alloc_release(start, next);
+		
+		start = next;
+	}
+}
+
+/* build the free space from the gaps between the files in gMap */
+void alloc_init(const uint8_t *rom, size_t romSz)
+{
+	uint32_t pos = 0;
+	
+	gFree.num = 0;
+	gFree.ready = true;
+	
+	for (int i = 0; i < gMap.num; ++i)
+	{
+		const struct romFile *f = &gMap.file[i];
+		
+		if (f->end < f->start || f->end > romSz)
+			continue;
+		
+		if (f->start > pos)
+			alloc_add_gap(rom, pos, f->start);
+		
+		if (f->end > pos)
+			pos = f->end;
+	}
+	
+	if (romSz > pos)
+		alloc_add_gap(rom, pos, romSz);
+}
+
+/* best-fit allocation of size bytes, 16-byte aligned
+ * returns 0 on failure
+ * returns rom offset of the allocated space on success
+ */
+uint32_t alloc_space(uint32_t size)
+{
+	int pos = alloc_lower_bound(align_up(size), 0);
+	struct freeBlock b;
+	
+	if (!size || pos >= gFree.num)
+		return 0;
+	
+	b = gFree.block[pos];
+	alloc_remove(pos);
+	alloc_insert(b.start + align_up(size), b.end);
+	
+	return b.start;
+}
+
+//
+//
+// defragmenter
+//
+//
+
+/* returns true if [start, end) holds a hard-coded patch target,
+ * so the file there must stay where it is for reruns to patch it
+ */
+static bool patch_pinned(uint32_t start, uint32_t end)
+{
+	for (int i = 0; i < PATCH_COUNT; ++i)
+		if (start < gPatchTarget[i].end && end > gPatchTarget[i].start)
+			return true;
+	
+	return false;
+}
+
+/* a file relocated by defrag(), or folded into a copy by dedup() */
+struct romMove
+{
+	uint32_t start; // old
+	uint32_t end; // old
+	uint32_t to; // new start
+};
+
+/* the move containing old rom offset off, or 0 if it didn't move */
+static const struct romMove *defrag_find(const struct romMove *move, int num, uint32_t off)
+{
+	int lo = 0;
+	int hi = num;
+	
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		
+		if (move[mid].end <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if (lo < num && move[lo].start <= off && off < move[lo].end)
+		return &move[lo];
+	
+	return 0;
+}
+
+/* new location of old rom offset off */
+static uint32_t defrag_translate(const struct romMove *move, int num, uint32_t off)
+{
+	const struct romMove *m = defrag_find(move, num, off);
+	
+	return m ? off - m->start + m->to : off;
+}
+
+/* rewrites the (start, end) pair at b if its file moved */
+static void defrag_repoint(const struct romMove *move, int num, uint8_t *b)
+{
+	const uint32_t start = BEu32(b);
+	const struct romMove *m;
+	
+	if (!start || !(m = defrag_find(move, num, start)) || m->start != start)
+		return;
+	
+	wBEu32(b, m->to);
+	wBEu32(b + 4, BEu32(b + 4) - start + m->to);
+}
+
+/* point every room list, table, and dmadata entry referencing a
+ * file in move[] (sorted by start) to the file's new location
+ */
+static void repoint_files(uint8_t *rom, const struct romMove *move, int num)
+{
+	for (int i = 0; i < gRoomRefs.num; ++i)
+		defrag_repoint(move, num, rom + gRoomRefs.off[i]);
+	
+	for (uint32_t i = OOT_SCENE_TABLE_START; i < OOT_SCENE_TABLE_END; i += 0x14)
+	{
+		defrag_repoint(move, num, rom + i);
+		defrag_repoint(move, num, rom + i + 8);
+	}
+	
+	for (uint32_t i = OOT_OBJECT_TABLE_START; i < OOT_OBJECT_TABLE_END; i += 0x8)
+		defrag_repoint(move, num, rom + i);
+	
+	for (uint32_t i = OOT_ACTOR_TABLE_START; i < OOT_ACTOR_TABLE_END; i += 0x20)
+		defrag_repoint(move, num, rom + i);
+	
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		struct dmaEntry *e = &gDma.entry[i];
+		const struct romMove *m;
+		
+		if (!e->start || !(m = defrag_find(move, num, e->start)) || m->start != e->start)
+			continue;
+		
+		e->end = e->end - e->start + m->to;
+		e->pstart = m->to;
+		e->dirty = true;
+		dma_set_start(i, m->to);
+	}
+	dma_commit(rom);
+}
+
+/* first 16-byte aligned offset at or after pos where sz bytes can
+ * go without landing on one of the fixed tables or patch targets;
+ * the tables live inside code, which already pins them in a
+ * well-formed rom, but nothing else guarantees dmadata lists the
+ * file they are in
+ */
+static uint32_t defrag_place(uint32_t pos, uint32_t sz)
+{
+	bool moved = true;
+	
+	pos = align_up(pos);
+	while (moved)
+	{
+		moved = false;
+		
+		for (size_t i = 0; i < sizeof(gFixedTable) / sizeof(*gFixedTable); ++i)
+			if (pos < gFixedTable[i][1] && pos + sz > gFixedTable[i][0])
+				pos = align_up(gFixedTable[i][1]), moved = true;
+		
+		// nor on a hard-coded patch target (not ascending)
+		for (int i = 0; i < PATCH_COUNT; ++i)
+			if (pos < gPatchTarget[i].end && pos + sz > gPatchTarget[i].start)
+				pos = align_up(gPatchTarget[i].end), moved = true;
+	}
+	
+	return pos;
+}
+
+/* slide scenes, rooms, title cards, objects, and actors down over
+ * the gaps left by files that shrunk or were removed, repoint every
+ * table, room list, and dmadata entry that references them, then
+ * truncate the rom; files referenced only by dmadata (code, audio,
+ * textures, ...) may be referenced by hard-coded offsets elsewhere,
+ * so they stay put and everything else packs in around them; gaps
+ * that aren't blank hold data nothing lists, so they stay put too
+ */
+void defrag(uint8_t *rom, size_t *romSz)
+{
+	struct romMove *move;
+	uint32_t pos = 0;
+	uint32_t last = 0; // end of the files so far, where they were
+	uint32_t saved = 0;
+	int num = 0;
+	
+	map_build(rom);
+	if (map_check(*romSz))
+	{
+		fprintf(stderr, "not defragmenting a rom with overlapping files\n");
+		return;
+	}
+	
+	if (!(move = malloc(gMap.num * sizeof(*move))))
+	{
+		fprintf(stderr, "defrag: out of memory\n");
+		return;
+	}
+	
+	// every run of identical ranges in gMap is one file
+	for (int i = 0; i < gMap.num; )
+	{
+		uint32_t start = gMap.file[i].start;
+		uint32_t end = gMap.file[i].end;
+		bool movable = false;
+		
+		// movable unless dmadata is the only thing referencing it
+		for (; i < gMap.num && gMap.file[i].start == start && gMap.file[i].end == end; ++i)
+			if (gMap.file[i].type != FILE_DMA)
+				movable = true;
+		
+		// or the misc patches write into it
+		if (patch_pinned(start, end))
+			movable = false;
+		
+		// nothing slides down over unlisted data
+		if (start > last && !gap_is_blank(rom, last, start) && start > pos)
+			pos = start;
+		if (end > last)
+			last = end;
+		
+		if (movable && defrag_place(pos, end - start) < start)
+		{
+			uint32_t to = defrag_place(pos, end - start);
+			
+			rom_memmove(rom + to, rom + start, end - start);
+			rom_release(rom + to, (start - to) + (end - start));
+			move[num].start = start;
+			move[num].end = end;
+			move[num].to = to;
+			saved += start - to;
+			++num;
+			
+			end = to + (end - start);
+		}
+		
+		if (end > pos)
+			pos = end;
+	}
+	
+	if (!num)
+	{
+		free(move);
+		return;
+	}
+	
+	// nor is unlisted data past the last file truncated
+	if (*romSz > last && !gap_is_blank(rom, last, *romSz))
+		pos = *romSz;
+	
+	// room lists live inside scenes, which may have moved themselves
+	for (int i = 0; i < gRoomRefs.num; ++i)
+		gRoomRefs.off[i] = defrag_translate(move, num, gRoomRefs.off[i]);
+	
+	repoint_files(rom, move, num);
+	
+	// truncate, keeping the rom a whole number of megabytes,
+	// and every hard-coded patch target in it
+	if (pos < OOT_SCENE_TABLE_END)
+		pos = OOT_SCENE_TABLE_END;
+	for (int i = 0; i < PATCH_COUNT; ++i)
+		if (pos < gPatchTarget[i].end && gPatchTarget[i].end <= *romSz)
+			pos = gPatchTarget[i].end;
+	pos = (pos + 0xFFFFF) & ~0xFFFFF;
+	if (pos < *romSz)
+	{
+		fprintf(stderr, "defragmented: moved %d files, rom size %08x -> %08x\n"
+			, num, (unsigned)*romSz, pos
+		);
+		*romSz = pos;
+	}
+	else
+		fprintf(stderr, "defragmented: moved %d files, reclaimed %08x bytes\n", num, saved);
+	
+	free(move);
+}
+
+//
+//
+// deduplication
+//
+//
+
+/* a file as referenced by the tables, and its contents' hash */
+struct dedupFile
+{
+	uint32_t start;
+	uint32_t end;
+	uint64_t hash;
+};
+
+static void dedup_hash(void *ctx, int i)
+{
+	struct { const uint8_t *rom; struct dedupFile *file; } *c = ctx;
+	struct dedupFile *f = &c->file[i];
+	
+	f->hash = hash64(c->rom + f->start, f->end - f->start);
+	rom_release(c->rom + f->start, f->end - f->start);
+}
+
+static int dedup_cmp(const void *a, const void *b)
+{
+	const struct dedupFile *x = a;
+	const struct dedupFile *y = b;
+	
+	if (x->hash != y->hash)
+		return (x->hash > y->hash) - (x->hash < y->hash);
+	if (x->end - x->start != y->end - y->start)
+		return (x->end - x->start > y->end - y->start) ? 1 : -1;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static int move_cmp(const void *a, const void *b)
+{
+	const struct romMove *x = a;
+	const struct romMove *y = b;
+	
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+/* repoint byte-identical scenes, title cards, rooms, objects, and
+ * actors at a single copy (the lowest in the rom); the copies are
+ * left unreferenced, for defrag() to reclaim; dmadata entries of
+ * copies become duplicates of the kept file's entry, rather than
+ * being cleared, as the game stops searching dmadata at a blank
+ */
+void dedup(uint8_t *rom, size_t romSz)
+{
+	struct { const uint8_t *rom; struct dedupFile *file; } ctx = { rom, 0 };
+	struct dedupFile *file;
+	struct romMove *move;
+	uint32_t saved = 0;
+	int numFiles = 0;
+	int num = 0;
+	
+	map_build(rom);
+	if (map_check(romSz))
+	{
+		fprintf(stderr, "not deduplicating a rom with overlapping files\n");
+		return;
+	}
+	
+	file = malloc(gMap.num * sizeof(*file));
+	move = malloc(gMap.num * sizeof(*move));
+	if (!file || !move)
+	{
+		fprintf(stderr, "dedup: out of memory\n");
+		free(file);
+		free(move);
+		return;
+	}
+	
+	// files the tables reference; dmadata alone may mean hard-coded offsets
+	for (int i = 0; i < gMap.num; )
+	{
+		uint32_t start = gMap.file[i].start;
+		uint32_t end = gMap.file[i].end;
+		bool eligible = false;
+		
+		for (; i < gMap.num && gMap.file[i].start == start && gMap.file[i].end == end; ++i)
+			if (gMap.file[i].type != FILE_DMA)
+				eligible = true;
+		
+		if (eligible && end > start && !patch_pinned(start, end))
+		{
+			file[numFiles].start = start;
+			file[numFiles].end = end;
+			++numFiles;
+		}
+	}
+	
+	ctx.file = file;
+	parallel_for(numFiles, dedup_hash, &ctx);
+	qsort(file, numFiles, sizeof(*file), dedup_cmp);
+	
+	// runs of equal hashes and sizes; the first of each is the lowest
+	for (int i = 0; i < numFiles; )
+	{
+		const struct dedupFile *keep = &file[i];
+		const uint32_t sz = keep->end - keep->start;
+		
+		for (++i; i < numFiles && file[i].hash == keep->hash && file[i].end - file[i].start == sz; ++i)
+		{
+			// don't trust the hash alone
+			if (memcmp(rom + keep->start, rom + file[i].start, sz))
+				continue;
+			
+			move[num].start = file[i].start;
+			move[num].end = file[i].end;
+			move[num].to = keep->start;
+			saved += sz;
+			++num;
+		}
+	}
+	
+	if (num)
+	{
+		int k = 0;
+		
+		qsort(move, num, sizeof(*move), move_cmp);
+		
+		// room lists inside the copies are dead now; keep their bytes as-is
+		for (int i = 0; i < gRoomRefs.num; ++i)
+			if (!defrag_find(move, num, gRoomRefs.off[i]))
+				gRoomRefs.off[k++] = gRoomRefs.off[i];
+		gRoomRefs.num = k;
+		
+		repoint_files(rom, move, num);
+		
+		fprintf(stderr, "deduplicated %d files, %08x bytes now unreferenced\n", num, saved);
+	}
+	
+	free(file);
+	free(move);
+}
+
+//
+//
+// yaz0 compression
+//
+//
+
+#define YAZ0_WINDOW    0x1000
+#define YAZ0_MIN_MATCH 3
+#define YAZ0_MAX_MATCH 0x111
+#define YAZ0_HASH_BITS 15
+#define YAZ0_MAX_CHAIN 256
+
+/* hash chains over 3-byte prefixes, so finding a match looks at a
+ * bounded number of earlier positions instead of the whole window
+ */
+struct yaz0Matcher
+{
+	const uint8_t *src;
+	uint32_t sz;
+	int32_t head[1 << YAZ0_HASH_BITS];
+	int32_t prev[YAZ0_WINDOW];
+};
+
+static uint32_t yaz0_hash(const uint8_t *b)
+{
+	return ((b[0] << 16 | b[1] << 8 | b[2]) * 2654435761u) >> (32 - YAZ0_HASH_BITS);
+}
+
+static void yaz0_insert(struct yaz0Matcher *m, uint32_t pos)
+{
+	uint32_t h;
+	
+	if (pos + YAZ0_MIN_MATCH > m->sz)
+		return;
+	
+	h = yaz0_hash(m->src + pos);
+	m->prev[pos % YAZ0_WINDOW] = m->head[h];
+	m->head[h] = pos;
+}
+
+/* longest match for the bytes at pos; returns its length */
+static uint32_t yaz0_search(const struct yaz0Matcher *m, uint32_t pos, uint32_t *dist)
+{
+	const uint8_t *src = m->src;
+	uint32_t max = m->sz - pos;
+	uint32_t best = 0;
+	int32_t cand;
+	
+	if (max > YAZ0_MAX_MATCH)
+		max = YAZ0_MAX_MATCH;
+	if (max < YAZ0_MIN_MATCH)
+		return 0;
+	
+	cand = m->head[yaz0_hash(src + pos)];
+	for (int chain = 0; cand >= 0 && pos - cand <= YAZ0_WINDOW && chain < YAZ0_MAX_CHAIN; ++chain)
+	{
+		uint32_t len = 0;
+		
+		// a stale link means this position was overwritten in the ring
+		if ((uint32_t)cand >= pos)
+			break;
+		
+		if (src[cand + best] == src[pos + best])
+		{
+			while (len < max && src[cand + len] == src[pos + len])
+				++len;
+			
+			if (len > best)
+			{
+				best = len;
+				*dist = pos - cand;
+				if (len == max)
+					break;
+			}
+		}
+		
+		cand = m->prev[cand % YAZ0_WINDOW];
+	}
+	
+	return best >= YAZ0_MIN_MATCH ? best : 0;
+}
+
+/* yaz0-compress sz bytes of src into a new buffer
+ * returns 0 on failure
+ * returns pointer to the compressed data (*dstSz bytes) on success
+ */
+uint8_t *yaz0_encode(const uint8_t *src, uint32_t sz, uint32_t *dstSz)
+{
+	struct yaz0Matcher *m = malloc(sizeof(*m));
+	uint8_t *dst = malloc(16 + sz + sz / 8 + 1);
+	uint8_t *out;
+	uint8_t *code = 0;
+	uint32_t pos = 0;
+	int bit = 0;
+	
+	if (!m || !dst)
+	{
+		free(m);
+		free(dst);
+		return 0;
+	}
+	
+	m->src = src;
+	m->sz = sz;
+	memset(m->head, -1, sizeof(m->head));
+	
+	memcpy(dst, "Yaz0", 4);
+	for (int i = 0; i < 4; ++i)
+		dst[4 + i] = sz >> (24 - 8 * i);
+	memset(dst + 8, 0, 8);
+	out = dst + 16;
+	
+	while (pos < sz)
+	{
+		uint32_t dist = 0;
+		uint32_t len = yaz0_search(m, pos, &dist);
+		
+		// lazy matching: a literal now may enable a longer match next
+		if (len && len < YAZ0_MAX_MATCH)
+		{
+			uint32_t nextDist;
+			uint32_t next;
+			
+			yaz0_insert(m, pos);
+			next = yaz0_search(m, pos + 1, &nextDist);
+			if (next > len + 1)
+				len = 0;
+			m->head[yaz0_hash(src + pos)] = m->prev[pos % YAZ0_WINDOW];
+		}
+		
+		if (!bit)
+		{
+			code = out++;
+			*code = 0;
+			bit = 8;
+		}
+		--bit;
+		
+		if (!len)
+		{
+			*code |= 1 << bit;
+			*out++ = src[pos];
+			yaz0_insert(m, pos);
+			pos += 1;
+			continue;
+		}
+		
+		dist -= 1;
+		if (len >= 0x12)
+		{
+			*out++ = dist >> 8;
+			*out++ = dist;
+			*out++ = len - 0x12;
+		}
+		else
+		{
+			*out++ = ((len - 2) << 4) | (dist >> 8);
+			*out++ = dist;
+		}
+		
+		for (uint32_t i = 0; i < len; ++i)
+			yaz0_insert(m, pos + i);
+		pos += len;
+	}
+	
+	free(m);
+	*dstSz = out - dst;
+	
+	return dst;
+}
+
+/* decode the yaz0 data in src (srcSz bytes) into dst, which
+ * must hold exactly dstSz bytes
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int yaz0_decode(const uint8_t *src, size_t srcSz, uint8_t *dst, uint32_t dstSz)
+{
+	const uint8_t *srcEnd = src + srcSz;
+	uint32_t pos = 0;
+	
+	if (srcSz < 16 || memcmp(src, "Yaz0", 4) || BEu32(src + 4) != dstSz)
+		return 0;
+	src += 16;
+	
+	while (pos < dstSz)
+	{
+		int code;
+		
+		if (src >= srcEnd)
+			return 0;
+		code = *src++;
+		
+		for (int bit = 7; bit >= 0 && pos < dstSz; --bit)
+		{
+			uint32_t dist;
+			uint32_t len;
+			
+			if (code & (1 << bit))
+			{
+				if (src >= srcEnd)
+					return 0;
+				dst[pos++] = *src++;
+				continue;
+			}
+			
+			if (src + 2 > srcEnd)
+				return 0;
+			dist = ((src[0] & 0xF) << 8 | src[1]) + 1;
+			len = src[0] >> 4;
+			src += 2;
+			if (!len)
+			{
+				if (src >= srcEnd)
+					return 0;
+				len = *src++ + 0x12;
+			}
+			else
+				len += 2;
+			
+			if (dist > pos || len > dstSz - pos)
+				return 0;
+			
+			// byte by byte, because the ranges may overlap
+			for (uint32_t i = 0; i < len; ++i, ++pos)
+				dst[pos] = dst[pos - dist];
+		}
+	}
+	
+	return 1;
+}
+
+//
+//
+// compressed rom output
+//
+//
+
+/* dmadata indices the retail compression tools compress by default
+ * in this build of the game (everything else has to stay raw)
+ */
+#define COMPRESS_FIRST_A 9
+#define COMPRESS_LAST_A  14
+#define COMPRESS_FIRST_B 28
+
+struct compressJob
+{
+	const uint8_t *rom;
+	const struct dmaEntry *e;
+	uint8_t *dat; // yaz0 data, or 0 to store raw
+	uint32_t sz;
+};
+
+static void compress_job(void *ctx, int i)
+{
+	struct compressJob *job = (struct compressJob*)ctx + i;
+	const struct dmaEntry *e = job->e;
+	
+	job->dat = yaz0_encode(job->rom + e->start, e->end - e->start, &job->sz);
+	
+	// not worth it
+	if (job->dat && job->sz >= e->end - e->start)
+	{
+		free(job->dat);
+		job->dat = 0;
+	}
+}
+
+/* parse a list like "100-120,250" of dmadata indices into skip[] */
+static void compress_parse_skip(bool skip[DMA_COUNT], const char *list)
+{
+	while (list && *list)
+	{
+		char *end;
+		long first = strtol(list, &end, 0);
+		long last = first;
+		
+		if (end == list)
+			break;
+		if (*end == '-')
+			last = strtol(end + 1, &end, 0);
+		
+		for (long i = first; i <= last && i < DMA_COUNT; ++i)
+			if (i >= 0)
+				skip[i] = true;
+		
+		list = (*end == ',') ? end + 1 : 0;
+	}
+}
+
+/* the compressed rom holds dmadata's files and nothing else, so a
+ * file the tables reference that no dmadata entry covers would be
+ * lost, as would its vrom == rom fallback; data in the gaps between
+ * dmadata's files is lost too, but might be padding, so it is only
+ * warned about
+ * returns 0 if any file would be lost
+ * returns non-zero otherwise
+ */
+static int compress_check(const uint8_t *rom, size_t romSz)
+{
+	uint32_t covered = 0; // furthest end of dmadata's files so far
+	int lost = 0;
+	
+	map_build(rom);
+	for (int i = 0; i < gMap.num; )
+	{
+		const uint32_t start = gMap.file[i].start;
+		int j;
+		
+		if (start > covered && start <= romSz && !gap_is_blank(rom, covered, start))
+			fprintf(stderr, "warning: %08x %08x is not in dmadata, and won't be in the compressed rom\n"
+				, covered, start
+			);
+		
+		for (j = i; j < gMap.num && gMap.file[j].start == start; ++j)
+			if (gMap.file[j].type == FILE_DMA && gMap.file[j].end > covered)
+				covered = gMap.file[j].end;
+		
+		for (; i < j; ++i)
+		{
+			const struct romFile *f = &gMap.file[i];
+			
+			if (f->type != FILE_DMA && f->end > covered && f->end <= romSz)
+			{
+				fprintf(stderr, "%s %d %08x %08x is not in dmadata\n"
+					, gFileTypeName[f->type], f->index, f->start, f->end
+				);
+				++lost;
+			}
+			
+			// the uncovered file is data, not a gap
+			if (f->end > covered && f->end <= romSz)
+				covered = f->end;
+		}
+	}
+	
+	if (covered < romSz && !gap_is_blank(rom, covered, romSz))
+		fprintf(stderr, "warning: %08x %08x is not in dmadata, and won't be in the compressed rom\n"
+			, covered, (unsigned)romSz
+		);
+	
+	return !lost;
+}
+
+/* build a yaz0-compressed copy of a fixed rom, laid out in dmadata
+ * order, with dmadata's physical addresses filled in accordingly;
+ * files listed in skipList (dmadata indices), and ones that would
+ * not shrink, are stored raw
+ * returns 0 on failure
+ * returns pointer to the new rom (*outSz bytes) on success
+ */
+uint8_t *compress_rom(const uint8_t *rom, size_t romSz, const char *skipList, size_t *outSz)
+{
+	struct compressJob *job;
+	bool *skip = calloc(DMA_COUNT, sizeof(*skip));
+	size_t cap = ((romSz + DMA_COUNT * 16) + 0xFFFFF) & ~0xFFFFF;
+	uint8_t *out = calloc(cap, 1);
+	uint32_t pos = 0;
+	int num = 0;
+	bool ok = true;
+	
+	if (!compress_check(rom, romSz))
+	{
+		fprintf(stderr, "not compressing a rom with files dmadata doesn't list\n");
+		free(skip);
+		free(out);
+		return 0;
+	}
+	
+	if (!skip || !out || !(job = malloc(DMA_COUNT * sizeof(*job))))
+	{
+		free(skip);
+		free(out);
+		return 0;
+	}
+	
+	compress_parse_skip(skip, skipList);
+	
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		const struct dmaEntry *e = &gDma.entry[i];
+		
+		if (e->end <= e->start || e->end > romSz || e->pstart == 0xFFFFFFFF
+			|| dma_find(e->start) != i || skip[i]
+			|| i < COMPRESS_FIRST_A || (i > COMPRESS_LAST_A && i < COMPRESS_FIRST_B)
+		)
+			continue;
+		
+		job[num].rom = rom;
+		job[num].e = e;
+		job[num].dat = 0;
+		++num;
+	}
+	
+	parallel_for(num, compress_job, job);
+	
+	for (int i = 0, k = 0; ok && i < DMA_COUNT; ++i)
+	{
+		const struct dmaEntry *e = &gDma.entry[i];
+		uint8_t *b = out + OOT_DMADATA_START + i * DMA_STRIDE;
+		const uint8_t *src = rom + e->start;
+		uint32_t sz = e->end - e->start;
+		uint32_t pend = 0;
+		int first;
+		
+		if (dma_is_blank(e) || e->pstart == 0xFFFFFFFF || e->end > romSz || e->end < e->start)
+		{
+			memcpy(b, rom + OOT_DMADATA_START + i * DMA_STRIDE, DMA_STRIDE);
+			continue;
+		}
+		
+		// files sharing a vrom start (see dedup()) share one copy
+		if ((first = dma_find(e->start)) != i)
+		{
+			memcpy(b, out + OOT_DMADATA_START + first * DMA_STRIDE, DMA_STRIDE);
+			continue;
+		}
+		
+		// makerom, boot, and dmadata are read from fixed locations,
+		// which mustn't be behind what is already laid out
+		if (i < 3 && pos > e->start)
+		{
+			fprintf(stderr, "dmadata entry %d %08x %08x overlaps the files before it\n", i, e->start, e->end);
+			ok = false;
+			break;
+		}
+		else if (i < 3)
+			pos = e->start;
+		
+		if (k < num && job[k].e == e)
+		{
+			if (job[k].dat)
+			{
+				src = job[k].dat;
+				sz = job[k].sz;
+				pend = pos + ((sz + 15) & ~15);
+			}
+			++k;
+		}
+		
+		// overlapping files get a copy each, which may not fit
+		if (pos + (uint64_t)sz > cap)
+		{
+			fprintf(stderr, "dmadata's files don't fit in a %08x byte rom\n", (unsigned)cap);
+			ok = false;
+			break;
+		}
+		
+		memcpy(out + pos, src, sz);
+		wBEu32(b, e->start);
+		wBEu32(b + 4, e->end);
+		wBEu32(b + 8, pos);
+		wBEu32(b + 12, pend);
+		pos += (sz + 15) & ~15;
+	}
+	
+	for (int i = 0; i < num; ++i)
+		free(job[i].dat);
+	free(job);
+	free(skip);
+	
+	if (!ok)
+	{
+		free(out);
+		return 0;
+	}
+	
+	*outSz = (pos + 0xFFFFF) & ~0xFFFFF;
+	n64crc(out);
+	
+	fprintf(stderr, "compressed %d files, rom size %08x -> %08x\n", num, (unsigned)romSz, (unsigned)*outSz);
+	
+	return out;
+}
+
+//
+//
+// compressed rom input
+//
+//
+
+/* does the dmadata in this rom reference any yaz0 files */
+bool rom_is_compressed(const uint8_t *rom, size_t romSz)
+{
+	const uint8_t *dma = rom + OOT_DMADATA_START;
+	
+	if (romSz < OOT_DMADATA_START + DMA_COUNT * DMA_STRIDE
+		|| BEu32(dma + 2 * DMA_STRIDE) != OOT_DMADATA_START
+	)
+		return false;
+	
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		const uint8_t *b = dma + i * DMA_STRIDE;
+		uint32_t pstart = BEu32(b + 8);
+		uint32_t pend = BEu32(b + 12);
+		
+		if (pend && pstart != 0xFFFFFFFF && pend <= romSz && pstart + 4 <= pend
+			&& !memcmp(rom + pstart, "Yaz0", 4)
+		)
+			return true;
+	}
+	
+	return false;
+}
+
+struct decompressJob
+{
+	const uint8_t *rom;
+	uint8_t *out;
+	size_t romSz;
+	uint32_t start;
+	uint32_t end;
+	uint32_t pstart;
+	uint32_t pend;
+	bool failed;
+};
+
+static void decompress_job(void *ctx, int i)
+{
+	struct decompressJob *job = (struct decompressJob*)ctx + i;
+	uint32_t sz = job->end - job->start;
+	
+	if (!job->pend)
+	{
+		if (job->pstart + (size_t)sz > job->romSz)
+			job->failed = true;
+		else
+			memcpy(job->out + job->start, job->rom + job->pstart, sz);
+	}
+	else if (job->pend > job->romSz || job->pend < job->pstart
+		|| !yaz0_decode(job->rom + job->pstart, job->pend - job->pstart, job->out + job->start, sz)
+	)
+		job->failed = true;
+}
+
+static int decompress_job_cmp(const void *a, const void *b)
+{
+	const struct decompressJob *x = a;
+	const struct decompressJob *y = b;
+	uint32_t xs = x->end - x->start;
+	uint32_t ys = y->end - y->start;
+	
+	// largest first, so no thread is left decoding a big file alone
+	return (xs < ys) - (xs > ys);
+}
+
+/* expand a compressed rom into a new buffer laid out the way the
+ * fixes expect, with every file at its virtual address and dmadata
+ * updated to match
+ * returns 0 on failure
+ * returns pointer to the decompressed rom (*outSz bytes) on success
+ */
+uint8_t *decompress_rom(const uint8_t *rom, size_t romSz, size_t *outSz)
+{
+	const uint8_t *dma = rom + OOT_DMADATA_START;
+	struct decompressJob *job = malloc(DMA_COUNT * sizeof(*job));
+	uint8_t *out = 0;
+	uint32_t end = 0;
+	int num = 0;
+	
+	if (!job)
+		return 0;
+	
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		const uint8_t *b = dma + i * DMA_STRIDE;
+		struct decompressJob *j = &job[num];
+		
+		j->start = BEu32(b);
+		j->end = BEu32(b + 4);
+		j->pstart = BEu32(b + 8);
+		j->pend = BEu32(b + 12);
+		j->rom = rom;
+		j->romSz = romSz;
+		j->failed = false;
+		
+		if (j->end <= j->start || j->pstart == 0xFFFFFFFF)
+			continue;
+		
+		if (j->end > end)
+			end = j->end;
+		++num;
+	}
+	
+	// the retail decompressors pad to a multiple of 16 MiB
+	*outSz = ((size_t)end + 0xFFFFFF) & ~(size_t)0xFFFFFF;
+	if (!num || !(out = calloc(*outSz, 1)))
+	{
+		free(job);
+		return 0;
+	}
+	
+	for (int i = 0; i < num; ++i)
+		job[i].out = out;
+	qsort(job, num, sizeof(*job), decompress_job_cmp);
+	parallel_for(num, decompress_job, job);
+	
+	for (int i = 0; i < num; ++i)
+	{
+		if (job[i].failed)
+		{
+			fprintf(stderr, "failed to decompress file %08x %08x\n", job[i].start, job[i].end);
+			free(out);
+			free(job);
+			return 0;
+		}
+	}
+	
+	// every file now lives at its virtual address
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		uint8_t *b = out + OOT_DMADATA_START + i * DMA_STRIDE;
+		
+		if (BEu32(b + 4) <= BEu32(b) || BEu32(b + 8) == 0xFFFFFFFF)
+			continue;
+		
+		memcpy(b + 8, b, 4);
+		memset(b + 12, 0, 4);
+	}
+	
+	fprintf(stderr, "decompressed %d files, rom size %08x -> %08x\n", num, (unsigned)romSz, (unsigned)*outSz);
+	
+	free(job);
+	return out;
+}
+
+uint16_t BEu16(const void *src)
+{
+	const uint8_t *b = src;
+	
+	return (b[0] << 8) | b[1];
+}
+
+/* actor overlays stripped from actor lists; to maintain a variant
+ * for another mod, define it when building, e.g.
+ * -D'EXCLUDED_OVERLAYS(X)=X(0x0001) X(0x0017)'
+ */
+#ifndef EXCLUDED_OVERLAYS
+// XXX some of these slots are repurposed in Zelda's Birthday
+#define EXCLUDED_OVERLAYS(X) \
+	X(0x0001) /*X(0x0003)*/ X(0x0005) /*X(0x0006)*/ X(0x0017) X(0x001A) \
+	X(0x001F) X(0x0022) X(0x0031) X(0x0036) X(0x0053) X(0x0073) X(0x0074) \
+	X(0x0075) X(0x0076) X(0x0078) X(0x0079) X(0x007A) X(0x007B) X(0x007E) \
+	X(0x007F) X(0x0083) X(0x00A0) X(0x00B2) X(0x00CE) X(0x00D8) X(0x00EA) \
+	X(0x00EB) X(0x00F2) X(0x00F3) X(0x00FB) X(0x0109) X(0x010D) X(0x010E) \
+	X(0x0128) X(0x0129) X(0x0134) X(0x0154) X(0x015D) X(0x0161) X(0x0180) \
+	X(0x01AA)
+#endif
+
+// an id past the end of the actor table fails to compile here
+#define EXCLUDE_OVERLAY(ID) [ID] = true,
+static const bool gOverlayExcluded[OOT_ACTOR_TABLE_LENGTH] = {
+	EXCLUDED_OVERLAYS(EXCLUDE_OVERLAY)
+};
+#undef EXCLUDE_OVERLAY
+
+bool is_overlay_excluded(const uint16_t v)
+{
+	return v >= OOT_ACTOR_TABLE_LENGTH || gOverlayExcluded[v];
+}
+
+#define HEADER_NOT_FOUND UINT32_MAX
+
+#ifdef __GNUC__
+typedef uint64_t cmdLanes __attribute__((vector_size(32)));
+#endif
+
+/* first offset in off, off + 8, ... end (inclusive) holding an 8-byte
+ * header command that equals cmd in the bits set in mask (both as
+ * big-endian 64-bit words), e.g. cmd = (uint64_t)CMD_RFL << 56 with
+ * mask = 0xFFull << 56 finds the next room file list command
+ * returns HEADER_NOT_FOUND if there is none
+ */
+uint32_t header_find(const uint8_t *dat, uint32_t off, uint32_t end, uint64_t cmd, uint64_t mask)
+{
+	uint8_t b[16];
+	uint64_t pat;
+	uint64_t msk;
+	
+	// compare in memory order, so no byte swapping per command
+	for (int i = 0; i < 8; ++i)
+	{
+		b[i] = cmd >> (56 - 8 * i);
+		b[8 + i] = mask >> (56 - 8 * i);
+	}
+	memcpy(&pat, b, 8);
+	memcpy(&msk, b + 8, 8);
+	
+	#ifdef __GNUC__
+	{
+		const cmdLanes vpat = { pat, pat, pat, pat };
+		const cmdLanes vmsk = { msk, msk, msk, msk };
+		
+		// four commands at a time until one of them matches
+		for (; off <= end && end - off >= 24; off += 32)
+		{
+			cmdLanes v;
+			cmdLanes hit;
+			
+			memcpy(&v, dat + off, sizeof(v));
+			hit = (cmdLanes)((v & vmsk) == vpat);
+			if (hit[0] | hit[1] | hit[2] | hit[3])
+				break;
+		}
+	}
+	#endif
+	
+	for (; off <= end; off += 8)
+	{
+		uint64_t w;
+		
+		memcpy(&w, dat + off, 8);
+		if ((w & msk) == pat)
+			return off;
+	}
+	
+	return HEADER_NOT_FOUND;
+}
+
+bool is_header(uint8_t *room, const size_t roomSz, uint32_t off)
+{
+	const int stride = 8;
+	const uint64_t pat = (uint64_t)CMD_END << 56; // bigendian bytes 14000000 00000000
+	uint32_t end = (off & 0xffffff) + 0xA0; // a forgiving header length
+	
+	if ((off & 3) || (((off >> 24) != 0x03) && ((off >> 24) != 0x02)))
+		return false;
+	
+	// bounds safety
+	if (roomSz < (size_t)stride)
+		return false;
+	if (roomSz - stride < end)
+		end = roomSz - stride;
+	
+	// if end-header pattern is found, it's a header
+	return header_find(room, off & 0xffffff, end, pat, UINT64_MAX) != HEADER_NOT_FOUND;
+}
+
+//
+//
+// scene header walker
+//
+//
+
+#define HEADER_MAX_DEPTH 16
+
+/* (file, header offset) pairs already walked, so every header is
+ * processed once no matter how many lists reference it
+ */
+struct visitSet
+{
+	uint64_t *key;
+	int num;
+	int cap; // power of two
+};
+
+void visit_reset(struct visitSet *v)
+{
+	if (v->key)
+		memset(v->key, 0xff, v->cap * sizeof(*v->key));
+	v->num = 0;
+}
+
+void visit_free(struct visitSet *v)
+{
+	free(v->key);
+	memset(v, 0, sizeof(*v));
+}
+
+/* returns true if the header at off in the file at rom offset
+ * start has not been visited yet (and marks it visited)
+ */
+static bool visit_add(struct visitSet *v, uint32_t start, uint32_t off)
+{
+	uint64_t key = (uint64_t)start << 32 | off;
+	uint32_t slot;
+	
+	// keep the table at most half full
+	if ((v->num + 1) * 2 > v->cap)
+	{
+		uint64_t *old = v->key;
+		int oldCap = v->cap;
+		int cap = oldCap ? oldCap * 2 : 1024;
+		
+		if (!(v->key = malloc(cap * sizeof(*v->key))))
+		{
+			fprintf(stderr, "visit_add: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		v->cap = cap;
+		visit_reset(v);
+		
+		for (int i = 0; i < oldCap; ++i)
+			if (old[i] != UINT64_MAX)
+				visit_add(v, old[i] >> 32, old[i]);
+		free(old);
+	}
+	
+	for (slot = (key * 0x9E3779B97F4A7C15u) >> 40; ; ++slot)
+	{
+		uint64_t *k = &v->key[slot & (v->cap - 1)];
+		
+		if (*k == key)
+			return false;
+		
+		if (*k == UINT64_MAX)
+		{
+			*k = key;
+			++v->num;
+			return true;
+		}
+	}
+}
+
+/* what a walk wants done to dmadata and the room reference list,
+ * in walk order, so walks can run in parallel and commit later
+ */
+struct walkLog
+{
+	struct walkOp
+	{
+		uint32_t start; // room file, or rom offset of a room reference
+		uint32_t end; // 0 for a room reference
+		int index;
+	} *op;
+	int num;
+	int cap;
+	struct sceneGraph *graph; // also record the structure walked, if set
+};
+
+static void walk_log(struct walkLog *log, uint32_t start, uint32_t end, int index)
+{
+	if (log->num == log->cap)
+	{
+		struct walkOp *op;
+		int cap = log->cap ? log->cap * 2 : 64;
+		
+		if (!(op = realloc(log->op, cap * sizeof(*op))))
+		{
+			fprintf(stderr, "walk_log: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		log->op = op;
+		log->cap = cap;
+	}
+	
+	log->op[log->num].start = start;
+	log->op[log->num].end = end;
+	log->op[log->num].index = index;
+	log->num += 1;
+}
+
+/* room file found by a walk; applied right away if there is no log */
+static void walk_room_file(struct walkLog *log, uint8_t *rom, uint32_t start, uint32_t end, int index)
+{
+	if (log)
+		walk_log(log, start, end, index);
+	else
+		dma_file_exists(rom, start, end, "room", index);
+}
+
+static void walk_room_ref(struct walkLog *log, uint32_t off)
+{
+	if (log)
+		walk_log(log, off, 0, 0);
+	else
+		room_ref_add(off);
+}
+
+/* apply everything a walk logged, in order */
+static void walk_commit(struct walkLog *log, uint8_t *rom)
+{
+	for (int i = 0; i < log->num; ++i)
+	{
+		const struct walkOp *op = &log->op[i];
+		
+		if (op->end)
+			dma_file_exists(rom, op->start, op->end, "room", op->index);
+		else
+			room_ref_add(op->start);
+	}
+}
+
+/* the structure found by walks, for the scene index (see index_build()) */
+struct sceneGraph
+{
+	struct graphHeader
+	{
+		uint32_t start; // file holding the header
+		uint32_t end;
+		uint32_t off; // within the file
+		int parent; // header that led here, or -1
+	} *header;
+	struct graphCmd
+	{
+		uint32_t pos; // rom offset
+		int header;
+	} *cmd;
+	struct graphRoom
+	{
+		uint32_t start;
+		uint32_t end;
+		uint32_t ref; // rom offset of the room list entry
+		int header; // the room's own header, or -1 if it wasn't walked from here
+	} *room;
+	struct graphActors
+	{
+		uint32_t cmd; // rom offset of the command
+		uint32_t start; // rom offset of the first actor
+		int num;
+		int header;
+	} *actors;
+	int numHeader, capHeader;
+	int numCmd, capCmd;
+	int numRoom, capRoom;
+	int numActors, capActors;
+};
+
+static void *graph_grow(void *arr, int num, int *cap, size_t each)
+{
+	void *p;
+	int n;
+	
+	if (num < *cap)
+		return arr;
+	
+	n = *cap ? *cap * 2 : 256;
+	if (!(p = realloc(arr, n * each)))
+	{
+		fprintf(stderr, "graph_grow: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	*cap = n;
+	return p;
+}
+
+void graph_free(struct sceneGraph *g)
+{
+	free(g->header);
+	free(g->cmd);
+	free(g->room);
+	free(g->actors);
+	memset(g, 0, sizeof(*g));
+}
+
+/* returns the index of the new header record, or -1 if the
+ * walk isn't recording its structure
+ */
+static int graph_header(struct walkLog *log, const uint8_t *rom, const uint8_t *room, size_t roomSz, uint32_t off, int parent)
+{
+	struct sceneGraph *g = log ? log->graph : 0;
+	struct graphHeader *h;
+	
+	if (!g)
+		return -1;
+	
+	g->header = graph_grow(g->header, g->numHeader, &g->capHeader, sizeof(*g->header));
+	h = &g->header[g->numHeader];
+	h->start = room - rom;
+	h->end = h->start + roomSz;
+	h->off = off & 0xffffff;
+	h->parent = parent;
+	
+	return g->numHeader++;
+}
+
+static void graph_cmd(struct walkLog *log, uint32_t pos, int header)
+{
+	struct sceneGraph *g = log ? log->graph : 0;
+	
+	if (!g)
+		return;
+	
+	g->cmd = graph_grow(g->cmd, g->numCmd, &g->capCmd, sizeof(*g->cmd));
+	g->cmd[g->numCmd].pos = pos;
+	g->cmd[g->numCmd].header = header;
+	g->numCmd += 1;
+}
+
+static void graph_room(struct walkLog *log, uint32_t start, uint32_t end, uint32_t ref, int header)
+{
+	struct sceneGraph *g = log ? log->graph : 0;
+	
+	if (!g)
+		return;
+	
+	g->room = graph_grow(g->room, g->numRoom, &g->capRoom, sizeof(*g->room));
+	g->room[g->numRoom].start = start;
+	g->room[g->numRoom].end = end;
+	g->room[g->numRoom].ref = ref;
+	g->room[g->numRoom].header = header;
+	g->numRoom += 1;
+}
+
+static void graph_actors(struct walkLog *log, uint32_t cmd, uint32_t start, int num, int header)
+{
+	struct sceneGraph *g = log ? log->graph : 0;
+	
+	if (!g)
+		return;
+	
+	g->actors = graph_grow(g->actors, g->numActors, &g->capActors, sizeof(*g->actors));
+	g->actors[g->numActors].cmd = cmd;
+	g->actors[g->numActors].start = start;
+	g->actors[g->numActors].num = num;
+	g->actors[g->numActors].header = header;
+	g->numActors += 1;
+}
+
+/* hard-coded fixes for specific files, applied on entering a header */
+static void header_patch(uint8_t *room, size_t *roomSz, uint8_t *rom)
+{
+	#if 0 // XXX hard-coded spider house fix
+	// was once required but now the rom is stable without it
+	if (*roomSz == 0xfe40)
+	{
+		const uint8_t spider[] = {
+			0x15, 0x05, 0x00, 0x00, 0x00, 0x00, 0x13, 0x1C, 0x04, 0x06, 0x00, 0x00,
+			0x02, 0x00, 0x01, 0x30, 0x0E, 0x05, 0x00, 0x00, 0x02, 0x00, 0x00, 0xA8,
+			0x0C, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0xF8, 0x19, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0xAE, 0x8C,
+			0x06, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x60, 0x07, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x03, 0x0D, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x20,
+			0x00, 0x01, 0x00, 0x00, 0x02, 0x00, 0x00, 0x98, 0x11, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x01, 0x00, 0x13, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x64,
+			0x0F, 0x04, 0x00, 0x00, 0x02, 0x00, 0x01, 0x68, 0x1B, 0x1B, 0x00, 0x00,
+			0x02, 0x00, 0x02, 0x60, 0x02, 0x10, 0x00, 0x00, 0x02, 0x00, 0x05, 0x80,
+			0x1C, 0x00, 0x00, 0x00, 0x02, 0x00, 0x04, 0x4C, 0x1A, 0x00, 0x00, 0x00,
+			0x02, 0x00, 0x06, 0x00, 0x1E, 0x01, 0x00, 0x00, 0x02, 0x00, 0x04, 0x54,
+			0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+		};
+		
+		// it's a match
+		if (!memcmp(room, spider, sizeof(spider)))
+		{
+			// header fix: 11000000 00000100 -> 11000000 00000000
+			wU8(room + 0x56, 0x00);
+			
+			fprintf(stderr, "applying spider house patch\n");
+		}
+	}
+	#endif
+	
+	// XXX hard-coded Eagle Labyrinth dungeon fixes
+	{
+		// replace old collision with custom collision
+		// (loading time improved from 18 seconds to 1 second)
+		if (*roomSz == 0x1A7D0 && (room - rom) == 0x3913000)
+		{
+			fprintf(stderr, "applying eagle labyrinth collision patch\n");
+			
+			// inject custom collision data
+			rom_memcpy(room + 0x460, gEagleCollisionPayloadData, gEagleCollisionPayloadSize);
+			
+			// update header to reference new collision data
+			wBEu32(room + 0x24, 0x02002FDC);
+			
+			// shrink scene file
+			*roomSz = 0x3010;
+			
+			// quick warp to room11
+			if (false)
+			{
+				wBEu32(room + 0x2D8, 0x03986000);
+				wBEu32(room + 0x2D8 + 4, 0x0398A7E0);
+			}
+		}
+		
+		// room11: replace ladder
+		if (*roomSz == 0x47e0 && (room - rom) == 0x03986000 && room[0x31] == 0x15)
+		{
+			fprintf(stderr, "applying eagle labyrinth room 11 ladder patch\n");
+			wBEu16(room + 0x4670, PL_LADDER_ACTOR_ID);
+			wBEu16(room + 0x50, PL_LADDER_OBJECT_ID);
+			wU8(room + 0x29, 0x09);
+		}
+	}
+}
+
+/* one header being walked; lists of rooms and alternate headers
+ * are walked an entry at a time, pushing a frame for each one
+ */
+struct headerFrame
+{
+	uint8_t *room;
+	size_t *roomSz;
+	uint8_t *roomEnd; // as of entering the header
+	uint32_t off; // next command
+	uint8_t *list; // entry of the CMD_RFL or CMD_ALT list being walked
+	uint8_t listCmd; // 0 when not walking a list
+	int listIdx;
+	int listNum;
+	size_t childSz; // size of the room file being walked above this
+	bool waiting; // for that room to be finished
+	int graphId; // in the walk's scene graph
+	int childGraphId; // of that room's header, or -1
+};
+
+static void header_enter(struct headerFrame *f, uint8_t *room, size_t *roomSz, uint32_t off, uint8_t *rom, struct walkLog *log, int parent)
+{
+	f->room = room;
+	f->roomSz = roomSz;
+	f->roomEnd = room + *roomSz;
+	f->off = off & 0xffffff;
+	f->listCmd = 0;
+	f->waiting = false;
+	stat_add(STAT_HEADERS, 1);
+	
+	header_patch(room, roomSz, rom);
+	f->graphId = graph_header(log, rom, room, *roomSz, off, parent);
+}
+
+/* walks the header at off and every header and room it references,
+ * each (file, header) pair not yet in visited once; rom is 0 when
+ * walking a lone file; room changes go to log, if there is one
+ * returns false if there is no header at off
+ * returns true otherwise
+ */
+bool do_header(uint8_t *room, size_t *roomSz, uint32_t off, uint8_t *rom, struct visitSet *visited, struct walkLog *log)
+{
+	struct headerFrame stack[HEADER_MAX_DEPTH];
+	const uint8_t *base = rom ? rom : room;
+	const int stride = 8;
+	int depth = 0;
+	
+	if (!is_header(room, *roomSz, off))
+		return false;
+	
+	if (!visit_add(visited, room - base, off))
+		return true;
+	
+	header_enter(&stack[depth++], room, roomSz, off, rom, log, -1);
+	
+	while (depth)
+	{
+		struct headerFrame *f = &stack[depth - 1];
+		uint8_t *b;
+		
+		room = f->room;
+		roomSz = f->roomSz;
+		
+		// room file list
+		if (f->listCmd == CMD_RFL)
+		{
+			uint8_t *dat = f->list;
+			uint32_t start;
+			uint32_t end;
+			
+			if (f->waiting)
+			{
+				start = BEu32(dat);
+				
+				// possible resize
+				walk_room_file(log, rom, start, start + f->childSz, f->listIdx);
+				walk_room_ref(log, dat - rom);
+				graph_room(log, start, start + f->childSz, dat - rom, f->childGraphId);
+				f->waiting = false;
+				f->list += 8;
+				f->listIdx += 1;
+				continue;
+			}
+			
+			if (f->listIdx == f->listNum)
+			{
+				f->listCmd = 0;
+				continue;
+			}
+			
+			start = BEu32(dat);
+			end = BEu32(dat + 4);
+			f->childSz = end - start;
+			f->childGraphId = -1;
+			f->waiting = true;
+			
+			if (!visit_add(visited, start, 0x03000000))
+			{
+				// walked by an earlier list; just note the reference
+				walk_room_ref(log, dat - rom);
+				graph_room(log, start, end, dat - rom, -1);
+				f->waiting = false;
+				f->list += 8;
+				f->listIdx += 1;
+			}
+			else if (is_header(rom + start, f->childSz, 0x03000000))
+			{
+				if (depth == HEADER_MAX_DEPTH)
+					fprintf(stderr, "warning: headers nested too deeply at %08x\n", start);
+				else
+				{
+					header_enter(&stack[depth++], rom + start, &f->childSz, 0x03000000, rom, log, f->graphId);
+					f->childGraphId = stack[depth - 1].graphId;
+					stat_add(STAT_ROOMS, 1);
+				}
+			}
+			continue;
+		}
+		
+		// alternate headers
+		if (f->listCmd == CMD_ALT)
+		{
+			uint32_t addr;
+			
+			if (f->list > f->roomEnd - 4)
+			{
+				f->listCmd = 0;
+				continue;
+			}
+			
+			addr = BEu32(f->list);
+			f->list += 4;
+			
+			// skip addresses 00000000, parse all others
+			if (!addr)
+				continue;
+			
+			if (!is_header(room, *roomSz, addr))
+				f->listCmd = 0;
+			else if (!visit_add(visited, room - base, addr))
+				continue;
+			else if (depth == HEADER_MAX_DEPTH)
+				fprintf(stderr, "warning: headers nested too deeply at %08x\n", addr);
+			else
+				header_enter(&stack[depth++], room, roomSz, addr, rom, log, f->graphId);
+			continue;
+		}
+		
+		// end of the file, or of the header
+		if (f->off > *roomSz - stride || room[f->off] == CMD_END)
+		{
+			--depth;
+			continue;
+		}
+		
+		b = room + f->off;
+		f->off += stride;
+		graph_cmd(log, b - base, f->graphId);
+		
+		switch (*b)
+		{
+			// room file list
+			case CMD_RFL:
+			{
+				uint32_t addr = BEu32(b + 4);
+				
+				if (!addr || !b[1] || !rom)
+					break;
+				
+				f->list = room + (addr & 0xffffff);
+				f->listCmd = CMD_RFL;
+				f->listIdx = 0;
+				f->listNum = b[1];
+				break;
+			}
+			
+			case CMD_OBJ: // object list patching
+				break;
+			
+			case CMD_TXA: // transition actors
+			case CMD_ACT: // actor list
+			{
+				int num = b[1];
+				const int stride = 16;
+				uint32_t addr = BEu32(b + 4);
+				uint8_t *start = room + (addr & 0xffffff);
+				uint8_t *end = start + num * stride;
+				uint8_t *dat = start;
+				int off = (*b == CMD_TXA) ? 4 : 0;
+				
+				if (!addr || !num)
+					break;
+				
+				// keep the actors that stay, in order, in one pass
+				for (uint8_t *src = start; src < end; src += stride)
+				{
+					if (is_overlay_excluded(BEu16(src + off)))
+						continue;
+					
+					if (dat != src)
+						rom_memmove(dat, src, stride);
+					dat += stride;
+				}
+				
+				num = (dat - start) / stride;
+				stat_add(STAT_ACTORS_REMOVED, b[1] - num);
+				graph_actors(log, b - base, start - base, num, f->graphId);
+				rom_memset(dat, 0, end - dat);
+				wU8(b + 1, num);
+				break;
+			}
+			
+			// alternate headers
+			case CMD_ALT:
+			{
+				uint32_t addr = BEu32(b + 4);
+				
+				if (!addr)
+					break;
+				
+				f->list = room + (addr & 0xffffff);
+				f->listCmd = CMD_ALT;
+				break;
+			}
+		}
+	}
+	
+	return true;
+}
+
+/* write a custom payload for the table entry ent (start, end)
+ * it stays where the old file was if it fits there; otherwise it
+ * goes to the best-fitting free space, and dmadata follows it
+ * returns the rom offset the payload was written to
+ */
+static uint32_t inject_payload(uint8_t *rom, size_t romSz, const uint8_t *ent, const void *data, uint32_t size)
+{
+	uint32_t start = BEu32(ent);
+	uint32_t end = BEu32(ent + 4);
+	
+	if (!start || end < start || end - start < size || end > romSz)
+	{
+		uint32_t dst;
+		
+		if (!gFree.ready)
+		{
+			map_build(rom);
+			alloc_init(rom, romSz);
+		}
+		
+		// the space was blank when the free list was built, but
+		// the passes since then may have written to it
+		while ((dst = alloc_space(size)) && !is_blank(rom + dst, size))
+			fprintf(stderr, "free space at %08x is no longer blank, skipping it\n", dst);
+		
+		if (dst)
+		{
+			fprintf(stderr, "payload does not fit at %08x, claimed free space %08x-%08x\n", start, dst, dst + size);
+			if (start && end > start && end <= romSz)
+				dma_file_move(start, dst, dst + size);
+			start = dst;
+		}
+		else
+			fprintf(stderr, "warning: no free space for payload, writing it at %08x anyway\n", start);
+	}
+	
+	rom_memcpy(rom + start, data, size);
+	
+	return start;
+}
+
+//
+//
+// incremental re-fix
+//
+//
+
+#define INC_MAGIC "ZBRFINC1"
+
+/* regions hashed as a whole for --incremental */
+enum incTable
+{
+	INC_DMADATA,
+	INC_SCENE_TABLE,
+	INC_OBJECT_TABLE,
+	INC_ACTOR_TABLE,
+	INC_TABLES
+};
+
+static const uint32_t gIncTable[INC_TABLES][2] = {
+	{ OOT_DMADATA_START, OOT_DMADATA_END },
+	{ OOT_SCENE_TABLE_START, OOT_SCENE_TABLE_END },
+	{ OOT_OBJECT_TABLE_START, OOT_OBJECT_TABLE_END },
+	{ OOT_ACTOR_TABLE_START, OOT_ACTOR_TABLE_END },
+};
+
+/* what the last run left behind, per dmadata entry, so files that
+ * haven't changed since can be passed over; sidecar contents, stored
+ * big-endian, are the magic, the key, the rom size, the table hashes,
+ * then (start, end, hash) for every entry
+ */
+struct incFile
+{
+	uint32_t start;
+	uint32_t end;
+	uint64_t hash; // 0 if the entry isn't a file in the rom
+};
+
+static struct
+{
+	bool on; // the sidecar was loaded and applies to this rom
+	bool clean[DMA_COUNT]; // entry is unchanged since the last run
+	bool tablesClean[INC_TABLES];
+	struct incFile file[DMA_COUNT]; // of the rom before fixing, if on
+	int byStart[DMA_COUNT]; // entries of file[] that are files, by start
+	int numByStart;
+} gInc;
+
+/* fixes depend on the overlays excluded and the payloads injected,
+ * so a build that changes those can't use another build's sidecar
+ */
+static uint64_t inc_key(void)
+{
+	const uint64_t part[] = {
+		hash64(gOverlayExcluded, sizeof(gOverlayExcluded)),
+		hash64(gEagleCollisionPayloadData, gEagleCollisionPayloadSize),
+		hash64(gLadderActorPayloadData, gLadderActorPayloadSize),
+		hash64(gLadderObjectPayloadData, gLadderObjectPayloadSize),
+	};
+	
+	return hash64(part, sizeof(part));
+}
+
+static void inc_hash_job(void *ctx, int i)
+{
+	struct { const uint8_t *rom; size_t romSz; struct incFile *file; } *c = ctx;
+	struct incFile *f = &c->file[i];
+	const uint8_t *b = c->rom + OOT_DMADATA_START + i * DMA_STRIDE;
+	
+	if (f->hash)
+		return;
+	
+	f->start = BEu32(b);
+	f->end = BEu32(b + 4);
+	f->hash = 0;
+	if (f->end > f->start && f->end <= c->romSz)
+	{
+		f->hash = hash64(c->rom + f->start, f->end - f->start);
+		rom_release(c->rom + f->start, f->end - f->start);
+	}
+}
+
+/* hash every file in dmadata, and the tables, on all cores; files
+ * with a nonzero hash already in file are taken to be unchanged
+ */
+static void inc_hash(const uint8_t *rom, size_t romSz, struct incFile file[DMA_COUNT], uint64_t table[INC_TABLES])
+{
+	struct { const uint8_t *rom; size_t romSz; struct incFile *file; } ctx = { rom, romSz, file };
+	
+	parallel_for(DMA_COUNT, inc_hash_job, &ctx);
+	
+	for (int i = 0; i < INC_TABLES; ++i)
+		table[i] = hash64(rom + gIncTable[i][0], gIncTable[i][1] - gIncTable[i][0]);
+}
+
+static int inc_start_cmp(const void *a, const void *b)
+{
+	const uint32_t x = gInc.file[*(const int *)a].start;
+	const uint32_t y = gInc.file[*(const int *)b].start;
+	
+	return (x > y) - (x < y);
+}
+
+/* compare a rom about to be fixed against the sidecar fn, noting
+ * which files are as the last run left them
+ */
+void inc_begin(const uint8_t *rom, size_t romSz, const char *fn)
+{
+	struct incFile *file = gInc.file;
+	uint64_t table[INC_TABLES];
+	const size_t sz = 8 + 8 + 4 + INC_TABLES * 8 + DMA_COUNT * 16;
+	size_t fileSz;
+	uint8_t *dat;
+	const uint8_t *b;
+	int numClean = 0;
+	int numFiles = 0;
+	
+	memset(&gInc, 0, sizeof(gInc));
+	
+	if (!(dat = loadfile(fn, &fileSz)))
+		return;
+	
+	if (fileSz != sz
+		|| memcmp(dat, INC_MAGIC, 8)
+		|| BEu64(dat + 8) != inc_key()
+		|| BEu32(dat + 16) != romSz
+	)
+	{
+		fprintf(stderr, "incremental sidecar '%s' is for another rom or build, fixing everything\n", fn);
+		free(dat);
+		return;
+	}
+	
+	inc_hash(rom, romSz, file, table);
+	
+	b = dat + 20;
+	for (int i = 0; i < INC_TABLES; ++i, b += 8)
+		gInc.tablesClean[i] = BEu64(b) == table[i];
+	for (int i = 0; i < DMA_COUNT; ++i, b += 16)
+	{
+		gInc.clean[i] = file[i].hash
+			&& BEu32(b) == file[i].start
+			&& BEu32(b + 4) == file[i].end
+			&& BEu64(b + 8) == file[i].hash
+		;
+		numClean += gInc.clean[i];
+		numFiles += file[i].hash != 0;
+		if (file[i].hash)
+			gInc.byStart[gInc.numByStart++] = i;
+	}
+	qsort(gInc.byStart, gInc.numByStart, sizeof(*gInc.byStart), inc_start_cmp);
+	
+	gInc.on = true;
+	fprintf(stderr, "%d of %d files unchanged since the last run\n", numClean, numFiles);
+	free(dat);
+}
+
+/* returns true if the file starting at start is unchanged since
+ * the last run; this goes by dmadata as it was before fixing began,
+ * as do_rom() clears some entries that the walks then refill
+ */
+bool inc_file_clean(uint32_t start)
+{
+	int lo = 0;
+	int hi = gInc.numByStart;
+	bool clean = false;
+	
+	if (!gInc.on)
+		return false;
+	
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		
+		if (gInc.file[gInc.byStart[mid]].start < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	// every entry for the file has to be clean
+	for (; lo < gInc.numByStart && gInc.file[gInc.byStart[lo]].start == start; ++lo)
+	{
+		if (!gInc.clean[gInc.byStart[lo]])
+			return false;
+		clean = true;
+	}
+	
+	return clean;
+}
+
+/* returns true if dmadata entry i is as the last run left it */
+bool inc_entry_clean(int i)
+{
+	return gInc.on && gInc.clean[i];
+}
+
+/* returns true if the table is unchanged since the last run */
+bool inc_table_clean(enum incTable t)
+{
+	return gInc.on && gInc.tablesClean[t];
+}
+
+/* write the sidecar fn describing a fixed rom; only files that
+ * were moved, resized, or written to since inc_begin() are rehashed
+ */
+void inc_save(const uint8_t *rom, size_t romSz, const char *fn)
+{
+	static struct incFile file[DMA_COUNT];
+	uint64_t table[INC_TABLES];
+	uint8_t dat[8 + 8 + 4 + INC_TABLES * 8 + DMA_COUNT * 16];
+	uint8_t *b;
+	
+	dirty_finish();
+	for (int i = 0; i < DMA_COUNT; ++i)
+	{
+		const uint8_t *ent = rom + OOT_DMADATA_START + i * DMA_STRIDE;
+		const struct incFile *f = &gInc.file[i];
+		
+		file[i].hash = 0;
+		if (gInc.on && f->start == BEu32(ent) && f->end == BEu32(ent + 4)
+			&& !dirty_overlaps(f->start, f->end)
+		)
+			file[i] = *f;
+	}
+	inc_hash(rom, romSz, file, table);
+	b = dat + 20;
+	
+	memset(dat, 0, sizeof(dat));
+	memcpy(dat, INC_MAGIC, 8);
+	wBEu64(dat + 8, inc_key());
+	wBEu32(dat + 16, romSz);
+	for (int i = 0; i < INC_TABLES; ++i, b += 8)
+		wBEu64(b, table[i]);
+	for (int i = 0; i < DMA_COUNT; ++i, b += 16)
+	{
+		wBEu32(b, file[i].start);
+		wBEu32(b + 4, file[i].end);
+		wBEu64(b + 8, file[i].hash);
+	}
+	
+	if (!savefile(fn, dat, sizeof(dat)))
+		fprintf(stderr, "failed to write incremental sidecar '%s'\n", fn);
+}
+
+//
+//
+// parallel scene walk
+//
+//
+
+#define SCENE_COUNT ((OOT_SCENE_TABLE_END - OOT_SCENE_TABLE_START) / 0x14)
+
+struct sceneWalk
+{
+	uint8_t *ent; // scene table entry
+	uint32_t start;
+	size_t sz;
+	int group; // first scene sharing files with this one
+	int next; // next scene in the same group, or -1
+	bool clean; // group is unchanged since the last run (see inc_begin())
+	struct walkLog log;
+	struct visitSet visited; // for the whole group
+};
+
+struct sceneFileRef
+{
+	uint32_t start;
+	int scene;
+};
+
+struct sceneLinks
+{
+	struct sceneFileRef *ref;
+	int num;
+	int cap;
+	struct sceneLinkItem { uint32_t start, end, off; } *work;
+	int numWork;
+	int capWork;
+	struct visitSet seen;
+};
+
+static void *scene_links_grow(void *arr, int *cap, size_t each)
+{
+	int n = *cap ? *cap * 2 : 256;
+	void *p = realloc(arr, n * each);
+	
+	if (!p)
+	{
+		fprintf(stderr, "scene_links: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	*cap = n;
+	return p;
+}
+
+static void scene_links_push(struct sceneLinks *l, uint32_t start, uint32_t end, uint32_t off)
+{
+	if (l->numWork == l->capWork)
+		l->work = scene_links_grow(l->work, &l->capWork, sizeof(*l->work));
+	l->work[l->numWork].start = start;
+	l->work[l->numWork].end = end;
+	l->work[l->numWork].off = off;
+	l->numWork += 1;
+}
+
+static void scene_links_ref(struct sceneLinks *l, uint32_t start, int scene)
+{
+	if (l->num == l->cap)
+		l->ref = scene_links_grow(l->ref, &l->cap, sizeof(*l->ref));
+	l->ref[l->num].start = start;
+	l->ref[l->num].scene = scene;
+	l->num += 1;
+}
+
+/* note every file the walk of a scene could touch, without
+ * modifying anything; this errs on the side of finding too much
+ */
+static void scene_links(struct sceneLinks *l, uint8_t *rom, size_t romSz, int scene, uint32_t start, uint32_t end)
+{
+	const int stride = 8;
+	
+	visit_reset(&l->seen);
+	l->numWork = 0;
+	scene_links_ref(l, start, scene);
+	scene_links_push(l, start, end, 0x02000000);
+	
+	while (l->numWork)
+	{
+		const struct sceneLinkItem it = l->work[--l->numWork];
+		uint8_t *room = rom + it.start;
+		size_t roomSz = it.end - it.start;
+		
+		if (it.start >= romSz || it.end < it.start || it.end > romSz
+			|| !visit_add(&l->seen, it.start, it.off)
+			|| !is_header(room, roomSz, it.off)
+		)
+			continue;
+		
+		for (uint32_t off = it.off & 0xffffff; off + stride <= roomSz; off += stride)
+		{
+			uint8_t *b = room + off;
+			uint32_t addr = BEu32(b + 4) & 0xffffff;
+			
+			if (*b == CMD_END)
+				break;
+			
+			if (*b == CMD_ALT && addr)
+			{
+				for (uint32_t i = addr; i + 4 <= roomSz; i += 4)
+				{
+					uint32_t alt = BEu32(room + i);
+					
+					if (!alt)
+						continue;
+					if (!is_header(room, roomSz, alt))
+						break;
+					scene_links_push(l, it.start, it.end, alt);
+				}
+			}
+			else if (*b == CMD_RFL && addr)
+			{
+				for (uint32_t i = 0; i < b[1] && it.start + addr + (i + 1) * 8 <= romSz; ++i)
+				{
+					const uint8_t *dat = room + addr + i * 8;
+					
+					scene_links_ref(l, BEu32(dat), scene);
+					scene_links_push(l, BEu32(dat), BEu32(dat + 4), 0x03000000);
+				}
 			}
+		}
+		
+		rom_release(room, roomSz);
+	}
+}
+
+static int scene_ref_cmp(const void *a, const void *b)
+{
+	const struct sceneFileRef *x = a;
+	const struct sceneFileRef *y = b;
+	
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static int scene_group_root(struct sceneWalk *scene, int i)
+{
+	while (scene[i].group != i)
+		i = scene[i].group = scene[scene[i].group].group;
+	
+	return i;
+}
+
+struct sceneJobs
+{
+	uint8_t *rom;
+	struct sceneWalk *scene;
+	int *group;
+};
+
+static void scene_group_job(void *ctx, int i)
+{
+	struct sceneJobs *jobs = ctx;
+	struct sceneWalk *scene = jobs->scene;
+	struct visitSet *visited = &scene[jobs->group[i]].visited;
+	
+	// walk the group in table order, like a serial walk would
+	for (int k = jobs->group[i]; k >= 0; k = scene[k].next)
+	{
+		const struct walkLog *log = &scene[k].log;
+		
+		do_header(jobs->rom + scene[k].start, &scene[k].sz, 0x02000000, jobs->rom, visited, &scene[k].log);
+		
+		// no other group touches these files
+		rom_release(jobs->rom + scene[k].start, scene[k].sz);
+		for (int j = 0; j < log->num; ++j)
+			if (log->op[j].end > log->op[j].start)
+				rom_release(jobs->rom + log->op[j].start, log->op[j].end - log->op[j].start);
+	}
+}
+
+/* walk every scene and its rooms; scenes that share no files are
+ * walked in parallel, and what they found is committed to dmadata
+ * in scene table order, so the result matches a serial walk
+ */
+static void do_scenes(uint8_t *rom, size_t romSz)
+{
+	struct sceneWalk scene[SCENE_COUNT];
+	struct sceneLinks links = {0};
+	struct sceneJobs jobs = { rom, scene, 0 };
+	int tail[SCENE_COUNT];
+	int group[SCENE_COUNT];
+	bool dirty[SCENE_COUNT];
+	int numGroups = 0;
+	
+	// find the files reachable from each scene
+	for (int i = 0; i < SCENE_COUNT; ++i)
+	{
+		struct sceneWalk *s = &scene[i];
+		uint32_t end;
+		
+		memset(s, 0, sizeof(*s));
+		s->ent = rom + OOT_SCENE_TABLE_START + i * 0x14;
+		s->start = BEu32(s->ent);
+		end = BEu32(s->ent + 4);
+		s->sz = end - s->start;
+		s->group = i;
+		s->next = -1;
+		
+		if (s->start == 0 || end < s->start || s->start >= romSz)
+		{
+			s->group = -1;
+			continue;
+		}
+		
+		scene_links(&links, rom, romSz, i, s->start, end);
+	}
+	
+	// scenes reaching the same file go in the same group
+	qsort(links.ref, links.num, sizeof(*links.ref), scene_ref_cmp);
+	for (int i = 1; i < links.num; ++i)
+	{
+		if (links.ref[i].start == links.ref[i - 1].start)
+		{
+			int a = scene_group_root(scene, links.ref[i - 1].scene);
+			int b = scene_group_root(scene, links.ref[i].scene);
+			
+			// the lowest index roots its group
+			if (a < b)
+				scene[b].group = a;
 			else
-				return true;
+				scene[a].group = b;
+		}
+	}
+	
+	// groups whose files are all as the last run left them were
+	// fixed then, and are left alone (see --incremental)
+	for (int i = 0; i < SCENE_COUNT; ++i)
+		dirty[i] = !inc_table_clean(INC_SCENE_TABLE);
+	for (int i = 0; i < links.num; ++i)
+		if (!inc_file_clean(links.ref[i].start))
+			dirty[scene_group_root(scene, links.ref[i].scene)] = true;
+	
+	// chain each group's scenes in table order
+	for (int i = 0; i < SCENE_COUNT; ++i)
+	{
+		int root;
+		
+		if (scene[i].group < 0)
+			continue;
+		
+		if (!dirty[root = scene_group_root(scene, i)])
+		{
+			scene[i].clean = true;
+			stat_add(STAT_SCENES_SKIPPED, 1);
+			continue;
+		}
+			
+		if (root == i)
+			group[numGroups++] = i;
+		else
+			scene[tail[root]].next = i;
+		tail[root] = i;
+	}
+	
+	jobs.group = group;
+	parallel_for(numGroups, scene_group_job, &jobs);
+	
+	for (int i = 0; i < SCENE_COUNT; ++i)
+	{
+		struct sceneWalk *s = &scene[i];
+		
+		if (s->group < 0 || s->clean)
+			continue;
+			
+		walk_commit(&s->log, rom);
+		
+		// possible resize
+		dma_file_exists(rom, s->start, s->start + s->sz, "scene", i);
+		
+		// overwrite file end, in case of resize
+		wBEu32(s->ent + 4, s->start + s->sz);
+		
+		free(s->log.op);
+		visit_free(&s->visited);
+	}
+	
+	free(links.ref);
+	free(links.work);
+	visit_free(&links.seen);
+}
+
+/* returns true if patch target t lies inside the rom, warning if not */
+static bool patch_fits(enum patchTarget t, size_t romSz)
+{
+	if (gPatchTarget[t].end <= romSz)
+		return true;
+	
+	fprintf(stderr, "warning: skipping %s patch past the end of the rom\n", gPatchTarget[t].name);
+	return false;
+}
+
+void do_rom(uint8_t *rom, size_t *romSzPtr)
+{
+	const size_t romSz = *romSzPtr;
+	const int spanScene = 0x14;
+	const int spanActor = 0x20;
+	const int spanObject = 0x8;
+	const int spanDma = 0x10;
+	
+	// already checked by the last run, if nothing they rely on changed
+	const bool tablesClean = inc_table_clean(INC_DMADATA)
+		&& inc_table_clean(INC_OBJECT_TABLE)
+		&& inc_table_clean(INC_ACTOR_TABLE)
+	;
+	
+	// XXX free up some dmadata and scene table entries to make room for customs;
+	// the entries the last run filled in are kept, because the groups
+	// and tables that filled them are not revisited (see --incremental)
+	stat_phase(PHASE_UNUSED);
+	gFree.ready = false;
+	gRoomRefs.num = 0;
+	for (int i = DMA_UNUSED_FIRST; i <= DMA_UNUSED_LAST; ++i)
+		if (!inc_entry_clean(i))
+			rom_memset(rom + OOT_DMADATA_START + i * spanDma, 0, spanDma);
+	rom_memset(rom + OOT_SCENE_TABLE_START + SCENE_UNUSED_FIRST * spanScene
+		, 0, ((SCENE_UNUSED_LAST + 1) - SCENE_UNUSED_FIRST) * spanScene
+	);
+	
+	dma_load(rom);
+	
+	stat_phase(PHASE_SCENES);
+	do_scenes(rom, romSz);
+	
+	// sanity check object table
+	stat_phase(PHASE_OBJECTS);
+	for (uint32_t i = OOT_OBJECT_TABLE_START; !tablesClean && i < OOT_OBJECT_TABLE_END; i += spanObject)
+	{
+		uint8_t *dat = rom + i;
+		uint32_t start = BEu32(dat);
+		uint32_t end = BEu32(dat + 4);
+		uint32_t sz = end - start;
+		int idx = (i - OOT_OBJECT_TABLE_START) / spanObject;
+		
+		// XXX object payloads
+		{
+			// inject custom ladder object payload
+			if (idx == PL_LADDER_OBJECT_ID)
+			{
+				fprintf(stderr, "injecting custom ladder object\n");
+				sz = gLadderObjectPayloadSize;
+				start = inject_payload(rom, romSz, dat, gLadderObjectPayloadData, sz);
+				end = start + sz;
+			}
+		}
+		
+		if (start == 0 || end < start || start >= romSz)
+			continue;
+		
+		dma_file_exists(rom, start, start + sz, "object", idx);
+		wBEu32(dat, start);
+		wBEu32(dat + 4, start + sz);
+	}
+	
+	// sanity check actor table
+	stat_phase(PHASE_ACTORS);
+	for (uint32_t i = OOT_ACTOR_TABLE_START; !tablesClean && i < OOT_ACTOR_TABLE_END; i += spanActor)
+	{
+		uint8_t *dat = rom + i;
+		uint32_t start = BEu32(dat);
+		uint32_t end = BEu32(dat + 4);
+		uint32_t sz = end - start;
+		int idx = (i - OOT_ACTOR_TABLE_START) / spanActor;
+		
+		// XXX actor overlay payloads
+		{
+			// inject custom ladder actor payload
+			if (idx == PL_LADDER_ACTOR_ID)
+			{
+				const unsigned char addrs[24] = {
+					0x80, 0xB9, 0x59, 0xD0, 0x80, 0xB9, 0x60, 0xD0, 0x00, 0x00, 0x00, 0x00,
+					0x80, 0xB9, 0x5F, 0xB0, 0x80, 0x13, 0x82, 0xD4, 0x00, 0x00, 0x00, 0x00
+				};
+				fprintf(stderr, "injecting custom ladder actor\n");
+				rom_memcpy(dat + 8, addrs, sizeof(addrs));
+				sz = gLadderActorPayloadSize;
+				start = inject_payload(rom, romSz, dat, gLadderActorPayloadData, sz);
+				end = start + sz;
+				wBEu16(rom + start + 0x5E8, PL_LADDER_OBJECT_ID);
+			}
+		}
+		
+		if (start == 0 || end < start || start >= romSz)
+			continue;
+		
+		dma_file_exists(rom, start, start + sz, "actor", idx);
+		wBEu32(dat, start);
+		wBEu32(dat + 4, start + sz);
+	}
+	
+	// write back dmadata changes made by the passes above
+	stat_phase(PHASE_PATCHES);
+	dma_commit(rom);
+	
+	// look for files the passes above made overlap
+	map_build(rom);
+	if (map_check(romSz))
+		fprintf(stderr, "warning: the rom has overlapping or out-of-bounds files\n");
+	
+	// misc patches...
+	{
+		// saria crash fix
+		if (patch_fits(PATCH_SARIA, romSz))
+		{
+			uint8_t *saria = rom + 0x00EAB540;
+			
+			// restore original assembly
+			wBEu32(saria + 0xD98 + 0, 0x3C0E8016); // lui t6, 0x8016
+			wBEu32(saria + 0xD98 + 4, 0xA6000210); // sh r0, 0x0210(s0)
+			
+			// disable Kokiri Forest cutscene
+			wBEu32(saria + 0x9C4, 0x24020003); // addiu v0, r0, 0x0003 ; make branch 4 function same as branch 3
+		}
+		
+		// ganon battle fixes
+		{
+			fprintf(stderr, "applying ganon battle fixes\n");
+			
+			// update rauru cutscene to use function 0x5e
+			// (aka so it jumps to ENTR_SPOT20_1)
+			if (patch_fits(PATCH_RAURU, romSz))
+				wU8(rom + 0x2B0D681, 0x5e);
+			
+			// update entrance ENTR_SPOT20_1 aka 0x2ae
+			// to point to ganon battle
+			if (patch_fits(PATCH_ENTRANCE, romSz))
+				for (int i = 0; i < 4; ++i)
+					wBEu32(rom + 0xB9FE18 + i * 4, 0x4f004183);
+			
+			// restore missing zelda object in ganon battle
+			if (patch_fits(PATCH_ZELDA_OBJECT, romSz))
+			{
+				wU8(rom + 0x353f031, 0x08);
+				wU8(rom + 0x353f064, 0x00);
+				wU8(rom + 0x353f064 + 1, 0x60);
+			}
+			
+			// skip first ganon battle arena cutscene
+			if (patch_fits(PATCH_ARENA, romSz))
+			{
+				wBEu32(rom + 0x3536328 + 0, 0x00760000);
+				wBEu32(rom + 0x3536328 + 4, 0x00010001);
+			}
+			
+			// now hide zelda using a more stable method
+			if (patch_fits(PATCH_ZL3, romSz))
+			{
+				uint8_t *zl3 = rom + 0xF090B0;
+				
+				for (int i = 0; i < 4; ++i)
+				{
+					// make ctor/dtor/main/draw do nothing
+					wBEu32(zl3 + 0x71D4 + i * 4, 0x80035118);
+					
+					// also ensure their addresses won't be relocated
+					wBEu32(zl3 + 0x838C + i * 4, 0x82000184);
+				}
+			}
+			
+			// and mute zelda's voice
+			for (int t = PATCH_ZELDA_VOICE; t <= PATCH_ZELDA_VOICE_LAST; ++t)
+				if (patch_fits(t, romSz))
+					rom_memset(rom + gPatchTarget[t].start, 0, gPatchTarget[t].end - gPatchTarget[t].start);
+		}
+	}
+	
+	// fold identical files into one copy
+	stat_phase(PHASE_DEDUP);
+	if (gOpt.dedup)
+		dedup(rom, romSz);
+	
+	// close the gaps left by shrunk files
+	stat_phase(PHASE_DEFRAG);
+	if (gOpt.defrag)
+		defrag(rom, romSzPtr);
+	
+	// update crc checksum
+	stat_phase(PHASE_CHECKSUM);
+	if (gOpt.crcCache)
+		n64crc_resume(rom, gOpt.crcCache);
+	else
+		n64crc(rom);
+	rom_release(rom + CHECKSUM_START, CHECKSUM_LENGTH);
+}
+
+//
+//
+// scene index
+//
+//
+
+/* a flat description of every scene's headers, rooms, and actor
+ * lists, written by --index so later runs and other tools can mmap
+ * it and jump straight to the records they need; like the rom, it
+ * is stored big-endian
+ *
+ * 0x00  magic, INDEX_MAGIC
+ * 0x08  u32 version, INDEX_VERSION
+ * 0x0C  u32 size of this header, INDEX_HEADER_SIZE
+ * 0x10  u64 hash64 of the file it describes, as written (so the
+ *       compressed rom, with --compress)
+ * 0x18  u32 size of that file
+ * 0x20  one { u32 file offset, u32 count, u32 record size } for each
+ *       section, in enum indexSection order
+ *
+ * records (offsets are uncompressed rom offsets unless noted, indices are within
+ * their section, and 0xFFFFFFFF means none):
+ * scene    u32 start, end, first header, headers, first room, rooms,
+ *          first actor list, actor lists; one per scene table entry,
+ *          all zero if the entry is unused
+ * header   u32 file start, file end, offset within the file, parent
+ *          header, first command, commands
+ * command  u32 offset, u8 command, u8 its second byte, u16 unused
+ * room     u32 start, end, room list entry, the room's own header
+ *          (none if it was walked from an earlier entry)
+ * actors   u32 command, first actor, header, u16 actors,
+ *          u8 command, u8 bytes per actor
+ */
+#define INDEX_MAGIC       "ZBRFSIDX"
+#define INDEX_VERSION     2
+#define INDEX_HEADER_SIZE 0x60
+#define INDEX_NONE        UINT32_MAX
+
+enum indexSection
+{
+	INDEX_SCENES,
+	INDEX_HEADERS,
+	INDEX_COMMANDS,
+	INDEX_ROOMS,
+	INDEX_ACTORS,
+	INDEX_SECTIONS
+};
+
+static const uint32_t gIndexStride[INDEX_SECTIONS] = { 0x20, 0x18, 0x08, 0x10, 0x10 };
+
+static uint32_t index_id(int i)
+{
+	return i < 0 ? INDEX_NONE : (uint32_t)i;
+}
+
+/* walk every scene of a fixed rom, recording what was found; as the
+ * rom is already fixed, the walk doesn't change anything; the index
+ * is keyed by hash, of the fileSz bytes written for the rom
+ * returns 0 on failure
+ * returns the index, which is *outSz bytes, otherwise
+ */
+uint8_t *index_build(uint8_t *rom, size_t romSz, uint64_t hash, size_t fileSz, size_t *outSz)
+{
+	struct sceneGraph g = {0};
+	struct walkLog log = {0};
+	struct visitSet visited = {0};
+	uint32_t num[INDEX_SECTIONS];
+	uint32_t off[INDEX_SECTIONS];
+	int *first; // first command of each header
+	int *next;
+	uint8_t *scenes;
+	uint8_t *dat;
+	uint8_t *b;
+	size_t sz = INDEX_HEADER_SIZE;
+	
+	if (!(scenes = calloc(SCENE_COUNT, gIndexStride[INDEX_SCENES])))
+		return 0;
+	
+	log.graph = &g;
+	for (int i = 0; i < SCENE_COUNT; ++i)
+	{
+		const uint8_t *ent = rom + OOT_SCENE_TABLE_START + i * 0x14;
+		uint32_t start = BEu32(ent);
+		uint32_t end = BEu32(ent + 4);
+		size_t sceneSz = end - start;
+		
+		b = scenes + i * gIndexStride[INDEX_SCENES];
+		if (start == 0 || end < start || start >= romSz)
+			continue;
+		
+		wBEu32(b + 0x00, start);
+		wBEu32(b + 0x04, end);
+		wBEu32(b + 0x08, g.numHeader);
+		wBEu32(b + 0x10, g.numRoom);
+		wBEu32(b + 0x18, g.numActors);
+		
+		// every scene gets the whole of its graph, shared rooms included
+		visit_reset(&visited);
+		log.num = 0;
+		do_header(rom + start, &sceneSz, 0x02000000, rom, &visited, &log);
+		
+		wBEu32(b + 0x0C, g.numHeader - BEu32(b + 0x08));
+		wBEu32(b + 0x14, g.numRoom - BEu32(b + 0x10));
+		wBEu32(b + 0x1C, g.numActors - BEu32(b + 0x18));
+	}
+	visit_free(&visited);
+	free(log.op);
+	
+	num[INDEX_SCENES] = SCENE_COUNT;
+	num[INDEX_HEADERS] = g.numHeader;
+	num[INDEX_COMMANDS] = g.numCmd;
+	num[INDEX_ROOMS] = g.numRoom;
+	num[INDEX_ACTORS] = g.numActors;
+	for (int i = 0; i < INDEX_SECTIONS; ++i)
+	{
+		off[i] = sz;
+		sz += num[i] * gIndexStride[i];
+	}
+	
+	// a header's commands are interleaved with those of the headers
+	// it leads to, so group them by header, keeping walk order
+	first = calloc(g.numHeader + 1, sizeof(*first));
+	next = malloc((g.numHeader + 1) * sizeof(*next));
+	if (!first || !next || !(dat = calloc(1, sz)))
+	{
+		free(first);
+		free(next);
+		free(scenes);
+		graph_free(&g);
+		return 0;
+	}
+	for (int i = 0; i < g.numCmd; ++i)
+		first[g.cmd[i].header + 1] += 1;
+	for (int i = 0; i < g.numHeader; ++i)
+		first[i + 1] += first[i];
+	memcpy(next, first, (g.numHeader + 1) * sizeof(*next));
+	
+	memcpy(dat, INDEX_MAGIC, 8);
+	wBEu32(dat + 0x08, INDEX_VERSION);
+	wBEu32(dat + 0x0C, INDEX_HEADER_SIZE);
+	wBEu64(dat + 0x10, hash);
+	wBEu32(dat + 0x18, fileSz);
+	for (int i = 0; i < INDEX_SECTIONS; ++i)
+	{
+		b = dat + 0x20 + i * 12;
+		wBEu32(b + 0, off[i]);
+		wBEu32(b + 4, num[i]);
+		wBEu32(b + 8, gIndexStride[i]);
+	}
+	
+	memcpy(dat + off[INDEX_SCENES], scenes, num[INDEX_SCENES] * gIndexStride[INDEX_SCENES]);
+	
+	for (int i = 0; i < g.numHeader; ++i)
+	{
+		const struct graphHeader *h = &g.header[i];
+		
+		b = dat + off[INDEX_HEADERS] + i * gIndexStride[INDEX_HEADERS];
+		wBEu32(b + 0x00, h->start);
+		wBEu32(b + 0x04, h->end);
+		wBEu32(b + 0x08, h->off);
+		wBEu32(b + 0x0C, index_id(h->parent));
+		wBEu32(b + 0x10, first[i]);
+		wBEu32(b + 0x14, first[i + 1] - first[i]);
+	}
+	
+	for (int i = 0; i < g.numCmd; ++i)
+	{
+		const struct graphCmd *c = &g.cmd[i];
+		
+		b = dat + off[INDEX_COMMANDS] + next[c->header]++ * gIndexStride[INDEX_COMMANDS];
+		wBEu32(b + 0x00, c->pos);
+		b[4] = rom[c->pos];
+		b[5] = rom[c->pos + 1];
+	}
+	
+	for (int i = 0; i < g.numRoom; ++i)
+	{
+		const struct graphRoom *r = &g.room[i];
+		
+		b = dat + off[INDEX_ROOMS] + i * gIndexStride[INDEX_ROOMS];
+		wBEu32(b + 0x00, r->start);
+		wBEu32(b + 0x04, r->end);
+		wBEu32(b + 0x08, r->ref);
+		wBEu32(b + 0x0C, index_id(r->header));
+	}
+	
+	for (int i = 0; i < g.numActors; ++i)
+	{
+		const struct graphActors *a = &g.actors[i];
+		
+		b = dat + off[INDEX_ACTORS] + i * gIndexStride[INDEX_ACTORS];
+		wBEu32(b + 0x00, a->cmd);
+		wBEu32(b + 0x04, a->start);
+		wBEu32(b + 0x08, index_id(a->header));
+		wBEu16(b + 0x0C, a->num);
+		b[0x0E] = rom[a->cmd];
+		b[0x0F] = 16;
+	}
+	
+	free(first);
+	free(next);
+	free(scenes);
+	graph_free(&g);
+	*outSz = sz;
+	return dat;
+}
+
+void index_unmap(const uint8_t *idx, size_t sz)
+{
+	#ifndef _WIN32
+	munmap((void *)idx, sz);
+	#else
+	free((void *)idx);
+	(void)sz;
+	#endif
+}
+
+/* map the scene index fn read-only, if it is a version this build
+ * understands and describes the rom (romSz bytes, hashing to hash)
+ * returns 0 if it isn't
+ * returns the index, which is *sz bytes, otherwise
+ */
+const uint8_t *index_map(const char *fn, uint64_t hash, size_t romSz, size_t *sz)
+{
+	uint8_t *dat;
+	bool ok;
+	
+	#ifndef _WIN32
+	struct stat st;
+	int fd;
+	
+	if ((fd = open(fn, O_RDONLY)) < 0)
+		return 0;
+	
+	dat = 0;
+	if (!fstat(fd, &st) && st.st_size >= INDEX_HEADER_SIZE)
+	{
+		*sz = st.st_size;
+		if ((dat = mmap(0, *sz, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+			dat = 0;
+	}
+	close(fd);
+	if (!dat)
+		return 0;
+	#else
+	if (!(dat = loadfile(fn, sz)))
+		return 0;
+	#endif
+	
+	ok = *sz >= INDEX_HEADER_SIZE
+		&& !memcmp(dat, INDEX_MAGIC, 8)
+		&& BEu32(dat + 0x08) == INDEX_VERSION
+		&& BEu32(dat + 0x0C) == INDEX_HEADER_SIZE
+		&& BEu64(dat + 0x10) == hash
+		&& BEu32(dat + 0x18) == romSz
+	;
+	
+	// every section has to fit
+	for (int i = 0; ok && i < INDEX_SECTIONS; ++i)
+	{
+		const uint8_t *b = dat + 0x20 + i * 12;
+		
+		ok = BEu32(b + 8) == gIndexStride[i]
+			&& BEu32(b) >= INDEX_HEADER_SIZE
+			&& BEu32(b) + (uint64_t)BEu32(b + 4) * gIndexStride[i] <= *sz
+		;
+	}
+	
+	if (!ok)
+	{
+		index_unmap(dat, *sz);
+		return 0;
+	}
+	
+	return dat;
+}
+
+/* write the scene index of a fixed rom to fn, keyed by the outSz
+ * bytes at out that were written for it (the rom itself, unless it
+ * was compressed), unless the one already there describes them
+ */
+void index_update(const char *fn, uint8_t *rom, size_t romSz, const uint8_t *out, size_t outSz)
+{
+	const uint64_t hash = hash64(out, outSz);
+	const uint8_t *old;
+	uint8_t *dat;
+	size_t sz;
+	
+	if ((old = index_map(fn, hash, outSz, &sz)))
+	{
+		index_unmap(old, sz);
+		fprintf(stderr, "scene index '%s' is up to date\n", fn);
+		return;
+	}
+	
+	if (!(dat = index_build(rom, romSz, hash, outSz, &sz)) || !savefile(fn, dat, sz))
+		fprintf(stderr, "failed to write scene index '%s'\n", fn);
+	else
+		fprintf(stderr, "wrote scene index '%s'\n", fn);
+	
+	free(dat);
+}
+
+/* fix one scene, room, or rom file, writing the result (or a patch
+ * when bps is set) to ofn, which may be the same file as fn
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int fix_file(const char *fn, const char *ofn, bool bps)
+{
+	const char *mapOfn;
+	uint8_t *room;
+	uint8_t *out = 0;
+	size_t roomSz;
+	size_t mappedSz = 0;
+	size_t srcSz;
+	uint32_t srcCrc = 0;
+	bool isRom = false;
+	int ok = 0;
+	
+	// compressed output (or stdout) is written separately,
+	// so leave the input alone
+	mapOfn = (bps || gOpt.compress || is_stream(ofn)) ? 0 : ofn;
+	
+	stats_begin();
+	stat_phase(PHASE_LOAD);
+	
+	#ifndef _WIN32
+	if (!is_stream(fn) && (room = mapfile(fn, mapOfn, &roomSz)))
+		mappedSz = roomSz;
+	else
+	#endif
+	if (!(room = loadfile(fn, &roomSz)))
+	{
+		fprintf(stderr, "failed to open or read input file '%s'\n", fn);
+		return 0;
+	}
+	
+	if (rom_is_compressed(room, roomSz))
+	{
+		uint8_t *raw;
+		size_t rawSz;
+		
+		if (bps)
+		{
+			fprintf(stderr, "--bps requires a decompressed rom\n");
+			goto cleanup;
+		}
+		
+		if (!(raw = decompress_rom(room, roomSz, &rawSz)))
+		{
+			fprintf(stderr, "failed to decompress input file '%s'\n", fn);
+			goto cleanup;
+		}
+		
+		// the input itself is left untouched; the result is saved below
+		#ifndef _WIN32
+		if (mappedSz)
+			munmap(room, mappedSz);
+		else
+		#endif
+		free(room);
+		room = raw;
+		roomSz = rawSz;
+		mappedSz = 0;
+	}
+	
+	srcSz = roomSz;
+	if (bps)
+		srcCrc = crc32(0, room, srcSz);
+	dirty_begin(room, roomSz);
+	
+	#ifndef _WIN32
+	// only pages of a shared mapping can be dropped without losing writes
+	if (gOpt.lowMem && mappedSz && mapOfn)
+		rom_release_begin(room, roomSz);
+	else if (gOpt.lowMem)
+		fprintf(stderr, "warning: --low-mem only applies when fixing an uncompressed file in place or to a new file\n");
+	#endif
+	
+	if (is_header(room, roomSz, 0x03000000))
+	{
+		struct visitSet visited = {0};
+		
+		stat_phase(PHASE_SCENES);
+		do_header(room, &roomSz, 0x03000000, 0, &visited, 0);
+		visit_free(&visited);
+	}
+	else if (roomSz > OOT_SCENE_TABLE_END)
+	{
+		if (gOpt.incremental)
+		{
+			stat_phase(PHASE_INCREMENTAL);
+			inc_begin(room, roomSz, gOpt.incremental);
+		}
+		do_rom(room, &roomSz);
+		if (gOpt.incremental)
+		{
+			stat_phase(PHASE_INCREMENTAL);
+			inc_save(room, roomSz, gOpt.incremental);
+		}
+		isRom = true;
+	}
+	
+	stat_phase(PHASE_SAVE);
+	if (bps)
+	{
+		dirty_finish();
+		if (!savebps(ofn, room, roomSz, srcSz, srcCrc))
+		{
+			fprintf(stderr, "failed to write patch file '%s'\n", ofn);
+			goto cleanup;
+		}
+		fprintf(stderr, "wrote %d modified ranges to '%s'\n", gDirty.num, ofn);
+	}
+	else if (gOpt.compress && isRom)
+	{
+		size_t outSz;
+		
+		if (!(out = compress_rom(room, roomSz, gOpt.compressSkip, &outSz))
+			|| !savefile(ofn, out, outSz)
+		)
+		{
+			fprintf(stderr, "failed to write compressed rom '%s'\n", ofn);
+			goto cleanup;
+		}
+		
+		// keyed by what was written, which is what other tools will see
+		stat_phase(PHASE_INDEX);
+		if (gOpt.index)
+			index_update(gOpt.index, room, roomSz, out, outSz);
+	}
+	else if (gOpt.compress && !savefile(ofn, room, roomSz))
+	{
+		fprintf(stderr, "failed to write output file '%s'\n", ofn);
+		goto cleanup;
+	}
+	
+	stat_phase(PHASE_INDEX);
+	if (gOpt.index && isRom && !gOpt.compress)
+		index_update(gOpt.index, room, roomSz, room, roomSz);
+	else if (gOpt.index && !isRom)
+		fprintf(stderr, "warning: --index only applies to roms\n");
+	
+	// not written through the mapping
+	if (!bps && !gOpt.compress && !(mappedSz && mapOfn) && !savefile(ofn, room, roomSz))
+	{
+		fprintf(stderr, "failed to write output file '%s'\n", fn);
+		goto cleanup;
+	}
+	
+	ok = 1;
+	
+	// every failure past loading the input ends up here, too
+cleanup:
+	#ifndef _WIN32
+	rom_release_end();
+	#endif
+	
+	free(out);
+	
+	#ifndef _WIN32
+	if (mappedSz)
+	{
+		if (!unmapfile(mapOfn, room, mappedSz, roomSz) && ok)
+		{
+			fprintf(stderr, "failed to write output file '%s'\n", fn);
+			ok = 0;
+		}
+	}
+	else
+	#endif
+	free(room);
+	
+	if (ok)
+		stats_report(fn);
+	return ok;
+}
+
+//
+//
+// file manifest
+//
+//
+
+static void manifest_hash(void *ctx, int i)
+{
+	struct { const uint8_t *rom; size_t romSz; uint64_t *hash; } *c = ctx;
+	const struct romFile *f = &gMap.file[i];
+	
+	// the same range listed by several tables is only hashed once
+	if (i && f->start == f[-1].start && f->end == f[-1].end)
+		return;
+	
+	c->hash[i] = 0;
+	if (f->end >= f->start && f->end <= c->romSz)
+		c->hash[i] = hash64(c->rom + f->start, f->end - f->start);
+}
+
+/* write a line for every file in dmadata and the scene, object,
+ * and actor tables of the rom fn to ofn (stdout if 0), sorted by
+ * start, end, type, and index:
+ * start end type index hash64
+ * files past the end of the rom get a hash of 0
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int write_manifest(const char *fn, const char *ofn)
+{
+	struct { const uint8_t *rom; size_t romSz; uint64_t *hash; } ctx;
+	struct bytebuf out = {0};
+	uint8_t *rom;
+	size_t romSz;
+	size_t mappedSz = 0;
+	int rval;
+	
+	#ifndef _WIN32
+	if (!is_stream(fn) && (rom = mapfile(fn, 0, &romSz)))
+		mappedSz = romSz;
+	else
+	#endif
+	if (!(rom = loadfile(fn, &romSz)))
+	{
+		fprintf(stderr, "failed to open or read input file '%s'\n", fn);
+		return 0;
+	}
+	
+	// describe the files, not how they happen to be stored
+	if (rom_is_compressed(rom, romSz))
+	{
+		uint8_t *raw;
+		size_t rawSz;
+		
+		if (!(raw = decompress_rom(rom, romSz, &rawSz)))
+		{
+			fprintf(stderr, "failed to decompress input file '%s'\n", fn);
+			return 0;
+		}
+		
+		#ifndef _WIN32
+		if (mappedSz)
+			munmap(rom, mappedSz);
+		else
+		#endif
+		free(rom);
+		rom = raw;
+		romSz = rawSz;
+		mappedSz = 0;
+	}
+	
+	if (romSz <= OOT_SCENE_TABLE_END)
+	{
+		fprintf(stderr, "'%s' is not a rom\n", fn);
+		return 0;
+	}
+	
+	dma_load(rom);
+	gRoomRefs.num = 0;
+	map_build(rom);
+	
+	if (!(ctx.hash = malloc(gMap.num * sizeof(*ctx.hash))))
+	{
+		fprintf(stderr, "write_manifest: out of memory\n");
+		return 0;
+	}
+	ctx.rom = rom;
+	ctx.romSz = romSz;
+	parallel_for(gMap.num, manifest_hash, &ctx);
+	
+	for (int i = 0; i < gMap.num; ++i)
+	{
+		const struct romFile *f = &gMap.file[i];
+		char line[64];
+		int n;
+		
+		if (i && f->start == f[-1].start && f->end == f[-1].end)
+			ctx.hash[i] = ctx.hash[i - 1];
+		
+		n = sprintf(line, "%08x %08x %s %d %016" PRIx64 "\n"
+			, f->start, f->end, gFileTypeName[f->type], f->index, ctx.hash[i]
+		);
+		bytebuf_put(&out, line, n);
+	}
+	
+	rval = !out.oom && savefile(ofn ? ofn : "-", out.dat, out.sz);
+	if (!rval)
+		fprintf(stderr, "failed to write manifest '%s'\n", ofn ? ofn : "-");
+	else
+		fprintf(stderr, "listed %d files\n", gMap.num);
+	
+	#ifndef _WIN32
+	if (mappedSz)
+		munmap(rom, mappedSz);
+	else
+	#endif
+	free(rom);
+	free(ctx.hash);
+	free(out.dat);
+	return rval;
+}
+
+//
+//
+// synthetic roms
+//
+//
+
+#define SYNTH_CODE_START  OOT_CODE_START // the tables live in code
+#define SYNTH_CODE_END    OOT_CODE_END
+#define SYNTH_FILES_START 0x02000000
+#define SYNTH_EAGLE_SCENE 0x03913000 // where do_header() expects them
+#define SYNTH_EAGLE_ROOM  0x03986000
+#define SYNTH_EAGLE_END   0x0398A7E0
+
+/* state for building a synthetic debug-rom-shaped image, for testing
+ * and benchmarking without the real (copyrighted) game
+ */
+struct synth
+{
+	uint8_t *rom;
+	size_t romSz;
+	uint64_t rng;
+	uint32_t cur; // next free rom offset
+	int numDma;
+	int rooms; // max rooms per scene
+	int actors; // max actors per list
+	uint32_t sharedStart; // last room made, for sharing between scenes
+	uint32_t sharedEnd;
+};
+
+static uint32_t synth_rand(struct synth *s, uint32_t n)
+{
+	// xorshift64*
+	s->rng ^= s->rng >> 12;
+	s->rng ^= s->rng << 25;
+	s->rng ^= s->rng >> 27;
+	
+	return ((s->rng * 0x2545F4914F6CDD1Dull) >> 32) % n;
+}
+
+static bool synth_chance(struct synth *s, int percent)
+{
+	return synth_rand(s, 100) < (uint32_t)percent;
+}
+
+static void synth_bytes(struct synth *s, uint8_t *dst, size_t n)
+{
+	while (n--)
+		*dst++ = synth_rand(s, 256);
+}
+
+static uint32_t synth_alloc(struct synth *s, uint32_t sz)
+{
+	uint32_t o = (s->cur + 15) & ~15;
+	
+	// keep clear of the files the eagle labyrinth patches look for
+	if (o < SYNTH_EAGLE_END && o + sz > SYNTH_EAGLE_SCENE)
+		o = SYNTH_EAGLE_END + 0x10000;
+	s->cur = o + sz;
+	
+	return o;
+}
+
+static void synth_dma(struct synth *s, uint32_t start, uint32_t end)
+{
+	uint8_t *b = s->rom + OOT_DMADATA_START + s->numDma * DMA_STRIDE;
+	
+	if (s->numDma == DMA_COUNT)
+		return;
+	
+	wBEu32(b, start);
+	wBEu32(b + 4, end);
+	wBEu32(b + 8, start);
+	wBEu32(b + 12, 0);
+	s->numDma += 1;
+}
+
+static uint8_t *synth_cmd(uint8_t *b, int cmd, int num, uint32_t addr)
+{
+	b[0] = cmd;
+	b[1] = num;
+	wBEu32(b + 4, addr);
+	
+	return b + 8;
+}
+
+/* num actor records, about a third of them using excluded overlays */
+static void synth_actors(struct synth *s, uint8_t *dat, int num, bool transition)
+{
+	const uint16_t excluded[] = { 0x0001, 0x0005, 0x0017, 0x0180, 0x01AA, 0x01F4 };
+	
+	for (int i = 0; i < num; ++i, dat += 16)
+	{
+		uint16_t id = 0x10 + synth_rand(s, OOT_ACTOR_TABLE_LENGTH - 0x10);
+		
+		if (synth_chance(s, 30))
+			id = excluded[synth_rand(s, sizeof(excluded) / sizeof(*excluded))];
+		
+		synth_bytes(s, dat, 16);
+		wBEu16(dat + (transition ? 4 : 0), id);
+	}
+}
+
+/* a room file at base (rom offset, or 0 within a lone buffer)
+ * returns its size
+ */
+static uint32_t synth_room(struct synth *s, uint8_t *room)
+{
+	int num = 1 + synth_rand(s, s->actors);
+	bool alt = synth_chance(s, 30);
+	uint8_t *b = room;
+	
+	// main header at 0, alternate header list at 0x20, the
+	// alternate header at 0x30, and the actor list at 0x40
+	if (alt)
+		b = synth_cmd(b, CMD_ALT, 0, 0x03000020);
+	b = synth_cmd(b, CMD_ACT, num, 0x03000040);
+	b = synth_cmd(b, CMD_OBJ, 0, 0);
+	synth_cmd(b, CMD_END, 0, 0);
+	
+	if (alt)
+	{
+		wBEu32(room + 0x20, 0x03000030);
+		wBEu32(room + 0x24, 0x01000000); // not a header: ends the list
+		synth_cmd(synth_cmd(room + 0x30, CMD_ACT, num, 0x03000040), CMD_END, 0, 0);
+	}
+	
+	synth_actors(s, room + 0x40, num, false);
+	
+	return 0x40 + num * 16 + 0x100 + synth_rand(s, 0x400);
+}
+
+static uint32_t synth_room_size(const struct synth *s)
+{
+	return 0x40 + s->actors * 16 + 0x500;
+}
+
+static void synth_scene(struct synth *s, int index)
+{
+	uint32_t room[255][2];
+	int numRooms = 1 + synth_rand(s, s->rooms);
+	int numAlt = synth_rand(s, 3);
+	int numTxa = synth_rand(s, 6);
+	uint32_t rflOff = 0x240;
+	uint32_t txaOff = (rflOff + numRooms * 8 + 15) & ~15;
+	uint32_t sz = txaOff + numTxa * 16 + 0x100 + synth_rand(s, 0x400);
+	uint32_t start;
+	uint8_t *scene;
+	uint8_t *b;
+	
+	for (int i = 0; i < numRooms; ++i)
+	{
+		if (s->sharedStart && synth_chance(s, 10))
+		{
+			room[i][0] = s->sharedStart;
+			room[i][1] = s->sharedEnd;
+			continue;
 		}
+		
+		start = synth_alloc(s, synth_room_size(s));
+		room[i][0] = start;
+		room[i][1] = start + synth_room(s, s->rom + start);
+		s->cur = room[i][1];
+		s->sharedStart = room[i][0];
+		s->sharedEnd = room[i][1];
+		
+		if (synth_chance(s, 50))
+			synth_dma(s, room[i][0], room[i][1]);
+	}
+	
+	start = synth_alloc(s, sz);
+	scene = s->rom + start;
+	
+	// main header at 0, alternate headers at 0x100, their list at
+	// 0x200, then the room list and the transition actors
+	b = scene;
+	if (numAlt)
+		b = synth_cmd(b, CMD_ALT, 0, 0x02000200);
+	b = synth_cmd(b, CMD_RFL, numRooms, 0x02000000 | rflOff);
+	if (numTxa)
+		b = synth_cmd(b, CMD_TXA, numTxa, 0x02000000 | txaOff);
+	synth_cmd(b, CMD_END, 0, 0);
+	
+	for (int i = 0; i < numAlt; ++i)
+	{
+		uint8_t *alt = scene + 0x100 + i * 0x20;
+		
+		wBEu32(scene + 0x200 + i * 4, synth_chance(s, 80) ? 0x02000100 + i * 0x20 : 0);
+		synth_cmd(synth_cmd(alt, CMD_RFL, numRooms, 0x02000000 | rflOff), CMD_END, 0, 0);
+	}
+	wBEu32(scene + 0x200 + numAlt * 4, 0x01000000);
+	
+	for (int i = 0; i < numRooms; ++i)
+	{
+		wBEu32(scene + rflOff + i * 8, room[i][0]);
+		wBEu32(scene + rflOff + i * 8 + 4, room[i][1]);
+	}
+	synth_actors(s, scene + txaOff, numTxa, true);
+	
+	wBEu32(s->rom + OOT_SCENE_TABLE_START + index * 0x14, start);
+	wBEu32(s->rom + OOT_SCENE_TABLE_START + index * 0x14 + 4, start + sz);
+	
+	if (synth_chance(s, 60))
+		synth_dma(s, start, start + (synth_chance(s, 80) ? sz : sz + 0x20));
+}
+
+/* forge the last word of the bootcode so N64GetCIC() sees a 6102 */
+static void synth_bootcode(struct synth *s)
+{
+	const uint32_t want = 0x90BB6CB5;
+	uint8_t *end = s->rom + 0x1000 - 4;
+	uint32_t table[256];
+	uint8_t topByte[256];
+	uint32_t state;
+	uint32_t need = ~want;
+	
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t c = i;
+		
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+		table[i] = c;
+		topByte[c >> 24] = i;
+	}
+	
+	state = ~crc32(0, s->rom + 0x40, end - (s->rom + 0x40));
+	
+	// run the crc backwards from the state we want
+	for (int i = 0; i < 4; ++i)
+	{
+		uint32_t idx = topByte[need >> 24];
+		
+		need = ((need ^ table[idx]) << 8) | idx;
+	}
+	
+	state ^= need;
+	for (int i = 0; i < 4; ++i)
+		end[i] = state >> (8 * i);
+}
+
+/* build a synthetic rom with up to rooms rooms per scene and actors
+ * actors per room; it has every table do_rom() reads, nested alternate
+ * headers, rooms shared between scenes, and the eagle labyrinth files
+ * returns 0 on failure
+ * returns pointer to the image (*romSz bytes) on success
+ */
+uint8_t *synth_rom(int rooms, int actors, uint64_t seed, size_t *romSz)
+{
+	struct synth s = {0};
+	size_t need;
+	
+	s.rooms = rooms < 1 ? 1 : rooms > 255 ? 255 : rooms;
+	s.actors = actors < 1 ? 1 : actors > 255 ? 255 : actors;
+	s.rng = seed ? seed : 1;
+	s.cur = SYNTH_FILES_START;
+	
+	need = SYNTH_FILES_START + 0x100000
+		+ SCENE_COUNT * (0x800 + s.rooms * 8 + (size_t)s.rooms * (synth_room_size(&s) + 16))
+		+ OOT_OBJECT_TABLE_LENGTH * 0x2000 + OOT_ACTOR_TABLE_LENGTH * 0x3000;
+	s.romSz = (need + 0xFFFFFF) & ~(size_t)0xFFFFFF;
+	if (s.romSz < 0x4000000)
+		s.romSz = 0x4000000;
+	
+	if (!(s.rom = calloc(s.romSz, 1)))
+		return 0;
+	
+	// header, bootcode, and the checksummed area
+	wBEu32(s.rom, 0x80371240);
+	synth_bytes(&s, s.rom + 0x40, 0x1000 - 0x40);
+	synth_bytes(&s, s.rom + CHECKSUM_START, CHECKSUM_LENGTH);
+	memset(s.rom + OOT_DMADATA_START, 0, OOT_DMADATA_END - OOT_DMADATA_START);
+	synth_bootcode(&s);
+	
+	synth_dma(&s, 0, 0x1000);
+	synth_dma(&s, 0x1000, OOT_DMADATA_START);
+	synth_dma(&s, OOT_DMADATA_START, OOT_DMADATA_END);
+	synth_dma(&s, SYNTH_CODE_START, SYNTH_CODE_END);
+	
+	for (int i = 0; i < SCENE_COUNT; ++i)
+		if (i < SCENE_UNUSED_FIRST || i > SCENE_UNUSED_LAST)
+			synth_scene(&s, i);
+	
+	// the eagle labyrinth scene and its room 11
+	{
+		uint8_t *scene = s.rom + SYNTH_EAGLE_SCENE;
+		uint8_t *room = s.rom + SYNTH_EAGLE_ROOM;
+		uint8_t *ent = s.rom + OOT_SCENE_TABLE_START + 0x60 * 0x14;
+		
+		synth_cmd(synth_cmd(scene, CMD_RFL, 1, 0x02000300), CMD_END, 0, 0);
+		wBEu32(scene + 0x300, SYNTH_EAGLE_ROOM);
+		wBEu32(scene + 0x304, SYNTH_EAGLE_END);
+		synth_cmd(synth_cmd(room, CMD_ACT, 2, 0x03000100), CMD_END, 0, 0);
+		room[0x31] = 0x15;
+		synth_actors(&s, room + 0x100, 2, false);
+		wBEu32(ent, SYNTH_EAGLE_SCENE);
+		wBEu32(ent + 4, SYNTH_EAGLE_SCENE + 0x1A7D0);
+		synth_dma(&s, SYNTH_EAGLE_SCENE, SYNTH_EAGLE_SCENE + 0x1A7D0);
 	}
 	
-	// doesn't exist in dmadata: add it
-	dma_file_add(oRom, start, end);
+	for (int i = 0; i < OOT_OBJECT_TABLE_LENGTH; ++i)
+	{
+		uint8_t *ent = s.rom + OOT_OBJECT_TABLE_START + i * 8;
+		uint32_t sz = (0x100 + synth_rand(&s, 0x1F00)) & ~15;
+		uint32_t start;
+		
+		if (i != PL_LADDER_OBJECT_ID && synth_chance(&s, 30))
+			continue;
+		
+		start = synth_alloc(&s, sz);
+		synth_bytes(&s, s.rom + start, 64);
+		wBEu32(ent, start);
+		wBEu32(ent + 4, start + sz);
+		if (synth_chance(&s, 50))
+			synth_dma(&s, start, start + sz);
+	}
 	
-	//fprintf(stderr, "%s %d %08x %08x error: no dma entry exists\n", type, index, start, end);
-	return false;
+	for (int i = 0; i < OOT_ACTOR_TABLE_LENGTH; ++i)
+	{
+		uint8_t *ent = s.rom + OOT_ACTOR_TABLE_START + i * 0x20;
+		uint32_t sz = (0x200 + synth_rand(&s, 0x2E00)) & ~15;
+		uint32_t vram = 0x80800000 + i * 0x10000;
+		uint32_t start;
+		
+		if (i != PL_LADDER_ACTOR_ID && synth_chance(&s, 50))
+			continue;
+		
+		start = synth_alloc(&s, sz);
+		synth_bytes(&s, s.rom + start, 64);
+		wBEu32(ent, start);
+		wBEu32(ent + 4, start + sz);
+		wBEu32(ent + 8, vram);
+		wBEu32(ent + 12, vram + sz);
+		if (synth_chance(&s, 50))
+			synth_dma(&s, start, start + sz);
+	}
 	
-	(void)type;
-	(void)index;
+	n64crc(s.rom);
+	*romSz = s.romSz;
+	
+	return s.rom;
 }
 
-uint16_t BEu16(const void *src)
+/* a lone room file, for testing the zworld path
+ * returns 0 on failure
+ * returns pointer to the file (*sz bytes) on success
+ */
+uint8_t *synth_zworld(int actors, uint64_t seed, size_t *sz)
 {
-	const uint8_t *b = src;
+	struct synth s = {0};
+	uint8_t *room;
 	
-	return (b[0] << 8) | b[1];
+	s.actors = actors < 1 ? 1 : actors > 255 ? 255 : actors;
+	s.rng = seed ? seed : 1;
+	
+	if (!(room = calloc(synth_room_size(&s), 1)))
+		return 0;
+	
+	*sz = synth_room(&s, room);
+	
+	return room;
 }
 
-bool is_overlay_excluded(const uint16_t v)
+/* write a synthetic file for --synth=FILE[,ROOMS[,ACTORS[,SEED]]]
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int synth_file(const char *arg)
 {
-	// XXX some of these slots are repurposed in Zelda's Birthday
-	const uint16_t unused[] = {
-		0x0001, /*0x0003,*/ 0x0005, /*0x0006,*/ 0x0017, 0x001A, 0x001F, 0x0022,
-		0x0031, 0x0036, 0x0053, 0x0073, 0x0074, 0x0075, 0x0076, 0x0078,
-		0x0079, 0x007A, 0x007B, 0x007E, 0x007F, 0x0083, 0x00A0, 0x00B2,
-		0x00CE, 0x00D8, 0x00EA, 0x00EB, 0x00F2, 0x00F3, 0x00FB, 0x0109,
-		0x010D, 0x010E, 0x0128, 0x0129, 0x0134, 0x0154, 0x015D, 0x0161,
-		0x0180, 0x01AA
-	};
-	const int num = sizeof(unused) / sizeof(*unused);
+	const char *comma = strchr(arg, ',');
+	size_t len = comma ? (size_t)(comma - arg) : strlen(arg);
+	long val[3] = { 3, 12, 1 };
+	char *fn = malloc(len + 1);
+	uint8_t *dat;
+	size_t sz;
+	int rval;
 	
-	if (v >= OOT_ACTOR_TABLE_LENGTH)
-		return true;
+	if (!fn)
+		return 0;
+	memcpy(fn, arg, len);
+	fn[len] = '\0';
 	
-	for (int i = 0; i < num; ++i)
-		if (unused[i] == v)
-			return true;
+	for (int i = 0; i < 3 && comma; ++i)
+	{
+		val[i] = strtol(comma + 1, (char**)&comma, 0);
+		if (*comma != ',')
+			comma = 0;
+	}
 	
-	return false;
+	if (has_ext(fn, ".zworld"))
+		dat = synth_zworld(val[1], val[2], &sz);
+	else
+		dat = synth_rom(val[0], val[1], val[2], &sz);
+	
+	rval = dat && savefile(fn, dat, sz);
+	if (!rval)
+		fprintf(stderr, "failed to write synthetic file '%s'\n", fn);
+	
+	free(dat);
+	free(fn);
+	return rval;
 }
 
-bool is_header(uint8_t *room, const size_t roomSz, uint32_t off)
+#ifndef _WIN32
+//
+//
+// benchmarks
+//
+//
+
+/* time n64crc_batch() against n64crc() on CRC_LANES roms, and check
+ * that both write the same checksums
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+static int bench_crc_batch(int iters)
 {
-	const int stride = 8;
-	const uint8_t pat[8] = { CMD_END }; // bigendian bytes 14000000 00000000
-	uint32_t end = (off & 0xffffff) + 0xA0; // a forgiving header length
+	const size_t sz = CHECKSUM_START + CHECKSUM_LENGTH; // all the checksum reads
+	uint8_t *head[CRC_LANES] = {0};
+	uint8_t *one[CRC_LANES] = {0};
+	uint8_t *orig;
+	size_t romSz;
+	double tOne = 0;
+	double tBatch = 0;
+	bool ok = true;
+	bool same = true;
 	
-	if ((off & 3) || (((off >> 24) != 0x03) && ((off >> 24) != 0x02)))
-		return false;
+	if (!(orig = synth_rom(2, 8, 1, &romSz)))
+		return 0;
 	
-	// bounds safety
-	if (roomSz - stride < end)
-		end = roomSz - stride;
+	for (int l = 0; l < CRC_LANES; ++l)
+	{
+		if (!(head[l] = malloc(sz)) || !(one[l] = malloc(sz)))
+		{
+			ok = false;
+			break;
+		}
+		memcpy(head[l], orig, sz);
+		head[l][CHECKSUM_START + l] ^= 1; // so every lane differs
+		memcpy(one[l], head[l], sz);
+	}
 	
-	// if end-header pattern is found, it's a header
-	for (off &= 0xffffff; off <= end; off += stride)
-		if (!memcmp(room + off, pat, stride))
-			return true;
+	for (int i = 0; ok && i < iters; ++i)
+	{
+		double t = stats_now();
+		
+		for (int l = 0; l < CRC_LANES; ++l)
+			n64crc(one[l]);
+		tOne += stats_now() - t;
+		
+		t = stats_now();
+		n64crc_batch((void **)head, CRC_LANES);
+		tBatch += stats_now() - t;
+	}
 	
-	// otherwise, it isn't
-	return false;
+	for (int l = 0; ok && l < CRC_LANES; ++l)
+		same &= !memcmp(head[l], one[l], sz);
+	
+	if (ok)
+		printf("%d roms: n64crc %.3f ms, n64crc_batch (%s) %.3f ms, %s\n"
+			, CRC_LANES, tOne * 1e3 / iters
+			#ifdef CRC_HAVE_LANES
+			, n64crc_lanes_pick() ? "avx2" : "serial"
+			#else
+			, "serial"
+			#endif
+			, tBatch * 1e3 / iters
+			, same ? "identical" : "FAILED, checksums differ"
+		);
+	
+	for (int l = 0; l < CRC_LANES; ++l)
+	{
+		free(head[l]);
+		free(one[l]);
+	}
+	free(orig);
+	return ok && same;
 }
 
-bool do_header(uint8_t *room, size_t *roomSz, uint32_t off, uint8_t *rom)
+/* fix a synthetic rom with --incremental, then fix the result again;
+ * nothing changed in between, so the second run has to leave every
+ * byte as it was (a plain rerun does)
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+static int bench_incremental(void)
 {
-	uint8_t *roomEnd = room + *roomSz;
-	const int stride = 8;
+	char side[] = "/tmp/zbrf-incXXXXXX";
+	uint8_t *rom[2] = {0};
+	size_t romSz[2];
+	size_t diff = 0;
+	int fd;
 	
-	if (!is_header(room, *roomSz, off))
-		return false;
+	// only the name is wanted, as the first run must not find a sidecar
+	if ((fd = mkstemp(side)) < 0)
+		return 0;
+	close(fd);
+	unlink(side);
 	
-	#if 0 // XXX hard-coded spider house fix
-	// was once required but now the rom is stable without it
-	if (*roomSz == 0xfe40)
+	if (!(rom[0] = synth_rom(16, 32, 1, &romSz[0])))
+		return 0;
+	
+	for (int run = 0; run < 2; ++run)
 	{
-		const uint8_t spider[] = {
-			0x15, 0x05, 0x00, 0x00, 0x00, 0x00, 0x13, 0x1C, 0x04, 0x06, 0x00, 0x00,
-			0x02, 0x00, 0x01, 0x30, 0x0E, 0x05, 0x00, 0x00, 0x02, 0x00, 0x00, 0xA8,
-			0x0C, 0x04, 0x00, 0x00, 0x02, 0x00, 0x00, 0xF8, 0x19, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0xAE, 0x8C,
-			0x06, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x60, 0x07, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x00, 0x03, 0x0D, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x20,
-			0x00, 0x01, 0x00, 0x00, 0x02, 0x00, 0x00, 0x98, 0x11, 0x00, 0x00, 0x00,
-			0x00, 0x00, 0x01, 0x00, 0x13, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x64,
-			0x0F, 0x04, 0x00, 0x00, 0x02, 0x00, 0x01, 0x68, 0x1B, 0x1B, 0x00, 0x00,
-			0x02, 0x00, 0x02, 0x60, 0x02, 0x10, 0x00, 0x00, 0x02, 0x00, 0x05, 0x80,
-			0x1C, 0x00, 0x00, 0x00, 0x02, 0x00, 0x04, 0x4C, 0x1A, 0x00, 0x00, 0x00,
-			0x02, 0x00, 0x06, 0x00, 0x1E, 0x01, 0x00, 0x00, 0x02, 0x00, 0x04, 0x54,
-			0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-		};
-		
-		// it's a match
-		if (!memcmp(room, spider, sizeof(spider)))
+		if (run && (rom[1] = malloc(romSz[0])))
 		{
-			// header fix: 11000000 00000100 -> 11000000 00000000
-			room[0x56] = 0x00;
-			
-			fprintf(stderr, "applying spider house patch\n");
+			memcpy(rom[1], rom[0], romSz[0]);
+			romSz[1] = romSz[0];
 		}
+		else if (run)
+			break;
+		
+		dirty_begin(rom[run], romSz[run]);
+		inc_begin(rom[run], romSz[run], side);
+		do_rom(rom[run], &romSz[run]);
+		inc_save(rom[run], romSz[run], side);
 	}
-	#endif
+	unlink(side);
+	memset(&gInc, 0, sizeof(gInc));
 	
-	// XXX hard-coded Eagle Labyrinth dungeon fixes
+	if (rom[1] && romSz[1] == romSz[0])
+		for (size_t i = 0; i < romSz[0]; ++i)
+			diff += rom[0][i] != rom[1][i];
+	
+	if (!rom[1] || romSz[1] != romSz[0] || diff)
+		printf("incremental rerun: FAILED, %zu bytes differ from the first run\n", diff);
+	else
+		printf("incremental rerun: identical\n");
+	
+	free(rom[0]);
+	free(rom[1]);
+	return rom[1] && romSz[1] == romSz[0] && !diff;
+}
+
+/* time the main passes on synthetic roms of a few sizes, printing
+ * a line per size; iters runs of each are averaged, then the checks
+ * above are run
+ * returns 0 if a check failed
+ * returns non-zero otherwise
+ */
+int bench(int iters)
+{
+	const int scale[][2] = { { 2, 8 }, { 6, 32 }, { 16, 96 } }; // rooms, actors
+	int devnull = open("/dev/null", O_WRONLY);
+	int err = dup(STDERR_FILENO);
+	int ok;
+	
+	if (iters < 1)
+		iters = 1;
+	
+	printf("%-14s %12s %12s %16s %12s\n", "rooms/actors", "n64crc", "do_header", "dma_file_exists", "do_rom");
+	
+	for (size_t k = 0; k < sizeof(scale) / sizeof(*scale); ++k)
 	{
-		// replace old collision with custom collision
-		// (loading time improved from 18 seconds to 1 second)
-		if (*roomSz == 0x1A7D0 && (room - rom) == 0x3913000)
+		double tCrc = 0;
+		double tHeader = 0;
+		double tDma = 0;
+		double tRom = 0;
+		int lookups = 0;
+		uint8_t *orig;
+		uint8_t *rom;
+		size_t romSz;
+		size_t sz;
+		
+		if (!(orig = synth_rom(scale[k][0], scale[k][1], 1, &romSz))
+			|| !(rom = malloc(romSz))
+		)
 		{
-			fprintf(stderr, "applying eagle labyrinth collision patch\n");
-			
-			// inject custom collision data
-			memcpy(room + 0x460, gEagleCollisionPayloadData, gEagleCollisionPayloadSize);
+			fprintf(stderr, "bench: out of memory\n");
+			free(orig);
+			break;
+		}
+		
+		// the passes are chatty, and that's not what is being timed
+		fflush(stderr);
+		dup2(devnull, STDERR_FILENO);
+		
+		for (int i = 0; i < iters; ++i)
+		{
+			struct visitSet visited = {0};
+			struct walkLog log = {0};
+			double t;
 			
-			// update header to reference new collision data
-			wBEu32(room + 0x24, 0x02002FDC);
+			memcpy(rom, orig, romSz);
 			
-			// shrink scene file
-			*roomSz = 0x3010;
+			t = stats_now();
+			n64crc(rom);
+			tCrc += stats_now() - t;
 			
-			// quick warp to room11
-			if (false)
+			// every scene, with the dmadata updates only logged
+			t = stats_now();
+			for (int s = 0; s < SCENE_COUNT; ++s)
 			{
-				wBEu32(room + 0x2D8, 0x03986000);
-				wBEu32(room + 0x2D8 + 4, 0x0398A7E0);
+				const uint8_t *ent = rom + OOT_SCENE_TABLE_START + s * 0x14;
+				uint32_t start = BEu32(ent);
+				
+				sz = BEu32(ent + 4) - start;
+				if (start && start < romSz)
+					do_header(rom + start, &sz, 0x02000000, rom, &visited, &log);
 			}
+			tHeader += stats_now() - t;
+			visit_free(&visited);
+			
+			// look up every file that was found
+			dma_load(rom);
+			t = stats_now();
+			for (int j = 0; j < log.num; ++j)
+				if (log.op[j].end)
+					dma_file_exists(rom, log.op[j].start, log.op[j].end, "room", j), ++lookups;
+			tDma += stats_now() - t;
+			free(log.op);
+			
+			memcpy(rom, orig, romSz);
+			sz = romSz;
+			t = stats_now();
+			do_rom(rom, &sz);
+			tRom += stats_now() - t;
 		}
 		
-		// room11: replace ladder
-		if (*roomSz == 0x47e0 && (room - rom) == 0x03986000 && room[0x31] == 0x15)
-		{
-			fprintf(stderr, "applying eagle labyrinth room 11 ladder patch\n");
-			wBEu16(room + 0x4670, PL_LADDER_ACTOR_ID);
-			wBEu16(room + 0x50, PL_LADDER_OBJECT_ID);
-			room[0x29] = 0x09;
-		}
+		fflush(stderr);
+		dup2(err, STDERR_FILENO);
+		
+		printf("%6d/%-7d %9.3f ms %9.3f ms %13.1f ns %9.3f ms\n"
+			, scale[k][0], scale[k][1]
+			, tCrc * 1e3 / iters
+			, tHeader * 1e3 / iters
+			, lookups ? tDma * 1e9 / lookups : 0.0
+			, tRom * 1e3 / iters
+		);
+		fflush(stdout);
+		
+		free(orig);
+		free(rom);
 	}
 	
-	for (off &= 0xffffff; off <= *roomSz - stride; off += stride)
+	ok = bench_crc_batch(iters);
+	
+	fflush(stderr);
+	dup2(devnull, STDERR_FILENO);
+	ok &= bench_incremental();
+	fflush(stderr);
+	dup2(err, STDERR_FILENO);
+	
+	close(devnull);
+	close(err);
+	return ok;
+}
+#endif
+
+//
+//
+// re-signing
+//
+//
+
+/* recalculate the checksum of each rom in fn[] in place, leaving the
+ * rest of the file alone; CRC_LANES roms are checksummed at a time
+ * with n64crc_batch() where the cpu has wide enough vectors
+ * returns the number of files that failed
+ */
+int resign_files(char *fn[], int num)
+{
+	int failed = 0;
+	
+	for (int i = 0; i < num; i += CRC_LANES)
 	{
-		uint8_t *b = room + off;
+		void *rom[CRC_LANES];
+		size_t sz[CRC_LANES];
+		bool mapped[CRC_LANES];
+		int which[CRC_LANES];
+		int n = 0;
 		
-		switch (*b)
+		for (int l = i; l < num && l < i + CRC_LANES; ++l)
 		{
-			// room file list
-			case CMD_RFL:
+			void *dat;
+			
+			mapped[n] = false;
+			#ifndef _WIN32
+			if (!is_stream(fn[l]) && (dat = mapfile(fn[l], fn[l], &sz[n])))
+				mapped[n] = true;
+			else
+			#endif
+			dat = loadfile(fn[l], &sz[n]);
+			
+			if (!dat || sz[n] < CHECKSUM_START + CHECKSUM_LENGTH || !N64GetCIC(dat))
 			{
-				int num = b[1];
-				const int stride = 8;
-				uint32_t addr = BEu32(b + 4);
-				uint8_t *dat = room + (addr & 0xffffff);
-				
-				if (!addr || !num || !rom)
-					break;
-				
-				for (int i = 0; i < num; ++i)
-				{
-					uint32_t start = BEu32(dat);
-					uint32_t end = BEu32(dat + 4);
-					size_t sz = end - start;
-					
-					do_header(rom + start, &sz, 0x03000000, rom);
-					
-					// possible resize
-					dma_file_exists(rom, start, start + sz, "room", i);
-					
-					dat += stride;
-				}
-				break;
+				fprintf(stderr, "'%s' is not a rom with a known bootcode\n", fn[l]);
+				#ifndef _WIN32
+				if (dat && mapped[n])
+					munmap(dat, sz[n]);
+				else
+				#endif
+				free(dat);
+				++failed;
+				continue;
 			}
 			
-			case CMD_OBJ: // object list patching
-				break;
+			rom[n] = dat;
+			which[n++] = l;
+		}
+		
+		n64crc_batch(rom, n);
+		
+		for (int l = 0; l < n; ++l)
+		{
+			const char *f = fn[which[l]];
+			int ok;
 			
-			case CMD_TXA: // transition actors
-			case CMD_ACT: // actor list
+			#ifndef _WIN32
+			if (mapped[l])
+				ok = unmapfile(f, rom[l], sz[l], sz[l]);
+			else
+			#endif
 			{
-				int num = b[1];
-				const int stride = 16;
-				uint32_t addr = BEu32(b + 4);
-				uint8_t *start = room + (addr & 0xffffff);
-				uint8_t *end = start + num * stride;
-				uint8_t *dat = start;
-				int off = (*b == CMD_TXA) ? 4 : 0;
-				
-				if (!addr || !num)
-					break;
-				
-				for (int i = 0; i < num; )
-				{
-					uint16_t overlay = BEu16(dat + off);
-					
-					if (is_overlay_excluded(overlay))
-					{
-						memmove(dat, dat + stride, (num - (i + 1)) * stride);
-						
-						--num;
-						continue;
-					}
-					
-					++i;
-					dat += stride;
-				}
-				
-				memset(dat, 0, end - dat);
-				b[1] = num;
-				break;
+				ok = savefile(f, rom[l], sz[l]);
+				free(rom[l]);
 			}
 			
-			// alternate headers
-			case CMD_ALT:
+			if (ok)
+				fprintf(stderr, "re-signed '%s'\n", f);
+			else
 			{
-				uint32_t addr = BEu32(b + 4);
-				uint8_t *dat = room + (addr & 0xffffff);
-				
-				if (!addr)
-					break;
-				
-				while (dat <= roomEnd - 4)
-				{
-					addr = BEu32(dat);
-					
-					// skip addresses 00000000, parse all others
-					if (addr && !do_header(room, roomSz, addr, rom))
-						break;
-					
-					dat += 4;
-				}
-				break;
+				fprintf(stderr, "failed to write '%s'\n", f);
+				++failed;
 			}
-			
-			// end
-			case CMD_END:
-				return true;
 		}
 	}
 	
-	return true;
+	return failed;
+}
+
+//
+//
+// batch mode
+//
+//
+
+#ifndef _WIN32
+struct batchJob
+{
+	char *fn;
+	char *ofn;
+	pid_t pid;
+	bool ok;
+};
+
+static struct
+{
+	struct batchJob *job;
+	int num;
+	int cap;
+	const char *outDir; // --out-dir=DIR, else files are fixed in place
+	int jobs; // --jobs=N
+} gBatch;
+
+static char *path_join(const char *dir, const char *name, const char *ext)
+{
+	size_t len = strlen(dir) + strlen(name) + strlen(ext) + 2;
+	char *path = malloc(len);
+	
+	if (!path)
+	{
+		fprintf(stderr, "path_join: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(path, len, "%s%s%s%s", dir, *dir ? "/" : "", name, ext);
+	
+	return path;
+}
+
+/* queue fn; outDir is where its output goes, 0 to fix it in place */
+static void batch_add(const char *fn, const char *outDir, bool bps)
+{
+	struct batchJob *job;
+	const char *name = strrchr(fn, '/');
+	
+	if (gBatch.num == gBatch.cap)
+	{
+		int cap = gBatch.cap ? gBatch.cap * 2 : 256;
+		
+		if (!(job = realloc(gBatch.job, cap * sizeof(*job))))
+		{
+			fprintf(stderr, "batch_add: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		gBatch.job = job;
+		gBatch.cap = cap;
+	}
+	
+	name = name ? name + 1 : fn;
+	job = &gBatch.job[gBatch.num++];
+	job->fn = path_join("", fn, "");
+	if (outDir)
+		job->ofn = path_join(outDir, name, bps ? ".bps" : "");
+	else
+		job->ofn = path_join("", fn, bps ? ".bps" : "");
+	job->pid = 0;
+	job->ok = false;
 }
 
-void do_rom(uint8_t *rom, const size_t romSz)
+/* queue every rom and zworld file under dir, mirroring the
+ * directory structure in outDir if there is one
+ */
+static int batch_add_dir(const char *dir, const char *outDir, bool bps)
 {
-	const int spanScene = 0x14;
-	const int spanActor = 0x20;
-	const int spanObject = 0x8;
-	const int spanDma = 0x10;
+	DIR *d = opendir(dir);
+	struct dirent *ent;
 	
-	// XXX free up some dmadata and scene table entries to make room for customs
-	memset(rom + OOT_DMADATA_START + DMA_UNUSED_FIRST * spanDma
-		, 0, ((DMA_UNUSED_LAST + 1) - DMA_UNUSED_FIRST) * spanDma
-	);
-	memset(rom + OOT_SCENE_TABLE_START + SCENE_UNUSED_FIRST * spanScene
-		, 0, ((SCENE_UNUSED_LAST + 1) - SCENE_UNUSED_FIRST) * spanScene
-	);
+	if (!d)
+		return 0;
 	
-	// for each entry in the scene table
-	for (uint32_t i = OOT_SCENE_TABLE_START; i < OOT_SCENE_TABLE_END; i += spanScene)
+	if (outDir)
+		mkdir(outDir, 0777);
+	
+	while ((ent = readdir(d)))
 	{
-		uint8_t *dat = rom + i;
-		uint32_t start = BEu32(dat);
-		uint32_t end = BEu32(dat + 4);
-		size_t sz = end - start;
+		char *path;
+		struct stat st;
 		
-		if (start == 0 || end < start || start >= romSz)
+		if (ent->d_name[0] == '.')
 			continue;
 		
-		//fprintf(stderr, "do scene %08x %08x\n", start, end);
-		do_header(rom + start, &sz, 0x02000000, rom);
+		path = path_join(dir, ent->d_name, "");
+		if (!stat(path, &st) && S_ISDIR(st.st_mode))
+		{
+			char *sub = outDir ? path_join(outDir, ent->d_name, "") : 0;
+			
+			batch_add_dir(path, sub, bps);
+			free(sub);
+		}
+		else if (has_ext(path, ".z64") || has_ext(path, ".zworld"))
+			batch_add(path, outDir, bps);
+		free(path);
+	}
+	
+	closedir(d);
+	return 1;
+}
+
+/* queue every file listed in a manifest, one path per line;
+ * blank lines and lines starting with # are skipped
+ */
+static int batch_add_manifest(const char *fn, bool bps)
+{
+	FILE *fp = fopen(fn, "r");
+	char line[4096];
+	
+	if (!fp)
+		return 0;
+	
+	if (gBatch.outDir)
+		mkdir(gBatch.outDir, 0777);
+	
+	while (fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
 		
-		// possible resize
-		dma_file_exists(rom, start, start + sz, "scene", (i - OOT_SCENE_TABLE_START) / spanScene);
+		if (*line && *line != '#')
+			batch_add(line, gBatch.outDir, bps);
+	}
+	
+	fclose(fp);
+	return 1;
+}
+
+/* queue an input given on the command line: a directory, a
+ * manifest (@list.txt), or a single file
+ * returns 0 on failure
+ * returns non-zero on success
+ */
+int batch_add_arg(const char *arg, bool bps)
+{
+	struct stat st;
+	
+	if (*arg == '@')
+		return batch_add_manifest(arg + 1, bps);
+	
+	if (stat(arg, &st))
+		return 0;
+	
+	if (S_ISDIR(st.st_mode))
+		return batch_add_dir(arg, gBatch.outDir, bps);
+	
+	if (gBatch.outDir)
+		mkdir(gBatch.outDir, 0777);
+	batch_add(arg, gBatch.outDir, bps);
+	
+	return 1;
+}
+
+struct batchFile
+{
+	dev_t dev;
+	ino_t ino;
+	int job;
+};
+
+static int batch_file_cmp(const void *a, const void *b)
+{
+	const struct batchFile *x = a;
+	const struct batchFile *y = b;
+	
+	if (x->dev != y->dev)
+		return (x->dev > y->dev) - (x->dev < y->dev);
+	if (x->ino != y->ino)
+		return (x->ino > y->ino) - (x->ino < y->ino);
+	return x->job - y->job;
+}
+
+static int batch_ofn_cmp(const void *a, const void *b)
+{
+	const struct batchJob *x = &gBatch.job[*(const int*)a];
+	const struct batchJob *y = &gBatch.job[*(const int*)b];
+	int d = strcmp(x->ofn, y->ofn);
+	
+	return d ? d : *(const int*)a - *(const int*)b;
+}
+
+/* make sure no two jobs write the same file, and that no job
+ * writes over an input (other than its own, when fixing in place)
+ * returns 0 if one would
+ * returns non-zero otherwise
+ */
+int batch_check(bool inPlace)
+{
+	struct batchFile *in = malloc((gBatch.num + 1) * sizeof(*in));
+	struct batchFile *out = malloc((gBatch.num + 1) * sizeof(*out));
+	int *order = malloc((gBatch.num + 1) * sizeof(*order));
+	int numIn = 0;
+	int numOut = 0;
+	int problems = 0;
+	
+	if (!in || !out || !order)
+	{
+		fprintf(stderr, "batch_check: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	for (int i = 0; i < gBatch.num; ++i)
+	{
+		struct stat st;
 		
-		// overwrite file end, in case of resize
-		wBEu32(dat + 4, start + sz);
+		order[i] = i;
+		if (!stat(gBatch.job[i].fn, &st))
+			in[numIn++] = (struct batchFile){ st.st_dev, st.st_ino, i };
+		if (!stat(gBatch.job[i].ofn, &st))
+			out[numOut++] = (struct batchFile){ st.st_dev, st.st_ino, i };
 	}
+	qsort(in, numIn, sizeof(*in), batch_file_cmp);
+	qsort(out, numOut, sizeof(*out), batch_file_cmp);
+	qsort(order, gBatch.num, sizeof(*order), batch_ofn_cmp);
 	
-	// sanity check object table
-	for (uint32_t i = OOT_OBJECT_TABLE_START; i < OOT_OBJECT_TABLE_END; i += spanObject)
+	// the same output name twice
+	for (int i = 1; i < gBatch.num; ++i)
 	{
-		uint8_t *dat = rom + i;
-		uint32_t start = BEu32(dat);
-		uint32_t end = BEu32(dat + 4);
-		uint32_t sz = end - start;
-		int idx = (i - OOT_OBJECT_TABLE_START) / spanObject;
+		const struct batchJob *a = &gBatch.job[order[i - 1]];
+		const struct batchJob *b = &gBatch.job[order[i]];
 		
-		// XXX object payloads
+		if (!strcmp(a->ofn, b->ofn))
 		{
-			// inject custom ladder object payload
-			if (idx == PL_LADDER_OBJECT_ID)
-			{
-				fprintf(stderr, "injecting custom ladder object\n");
-				memcpy(rom + start, gLadderObjectPayloadData, (sz = gLadderObjectPayloadSize));
-			}
+			fprintf(stderr, "'%s' and '%s' would both be written to '%s'\n", a->fn, b->fn, b->ofn);
+			++problems;
 		}
-		
-		if (start == 0 || end < start || start >= romSz)
-			continue;
-		
-		dma_file_exists(rom, start, start + sz, "object", idx);
-		wBEu32(dat, start);
-		wBEu32(dat + 4, start + sz);
 	}
 	
-	// sanity check actor table
-	for (uint32_t i = OOT_ACTOR_TABLE_START; i < OOT_ACTOR_TABLE_END; i += spanActor)
+	// the same existing output under different names
+	for (int i = 1; i < numOut; ++i)
 	{
-		uint8_t *dat = rom + i;
-		uint32_t start = BEu32(dat);
-		uint32_t end = BEu32(dat + 4);
-		uint32_t sz = end - start;
-		int idx = (i - OOT_ACTOR_TABLE_START) / spanActor;
+		const struct batchJob *a = &gBatch.job[out[i - 1].job];
+		const struct batchJob *b = &gBatch.job[out[i].job];
 		
-		// XXX actor overlay payloads
+		if (out[i].dev == out[i - 1].dev && out[i].ino == out[i - 1].ino && strcmp(a->ofn, b->ofn))
 		{
-			// inject custom ladder actor payload
-			if (idx == PL_LADDER_ACTOR_ID)
-			{
-				const unsigned char addrs[24] = {
-					0x80, 0xB9, 0x59, 0xD0, 0x80, 0xB9, 0x60, 0xD0, 0x00, 0x00, 0x00, 0x00,
-					0x80, 0xB9, 0x5F, 0xB0, 0x80, 0x13, 0x82, 0xD4, 0x00, 0x00, 0x00, 0x00
-				};
-				fprintf(stderr, "injecting custom ladder actor\n");
-				memcpy(dat + 8, addrs, sizeof(addrs));
-				memcpy(rom + start, gLadderActorPayloadData, (sz = gLadderActorPayloadSize));
-				wBEu16(rom + start + 0x5E8, PL_LADDER_OBJECT_ID);
-			}
+			fprintf(stderr, "'%s' and '%s' are the same file\n", a->ofn, b->ofn);
+			++problems;
 		}
+	}
+	
+	// an output that is an input
+	for (int i = 0, k = 0; i < numOut; ++i)
+	{
+		const struct batchFile *o = &out[i];
 		
-		if (start == 0 || end < start || start >= romSz)
-			continue;
+		while (k < numIn && (in[k].dev < o->dev || (in[k].dev == o->dev && in[k].ino < o->ino)))
+			++k;
 		
-		dma_file_exists(rom, start, start + sz, "actor", idx);
-		wBEu32(dat, start);
-		wBEu32(dat + 4, start + sz);
+		for (int j = k; j < numIn && in[j].dev == o->dev && in[j].ino == o->ino; ++j)
+		{
+			if (inPlace && in[j].job == o->job)
+				continue;
+			
+			fprintf(stderr, "'%s' would overwrite input '%s'\n", gBatch.job[o->job].ofn, gBatch.job[in[j].job].fn);
+			++problems;
+		}
 	}
 	
-	// misc patches...
+	free(in);
+	free(out);
+	free(order);
+	return !problems;
+}
+
+/* ask the kernel to start reading fn in the background, so it is
+ * (at least partly) cached by the time a worker gets to it
+ */
+static void batch_prefetch(const char *fn)
+{
+	#ifdef POSIX_FADV_WILLNEED
+	int fd = open(fn, O_RDONLY);
+	
+	if (fd < 0)
+		return;
+	
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+	#else
+	(void)fn;
+	#endif
+}
+
+/* wait for one worker to finish; returns how many are left running */
+static int batch_reap(int running)
+{
+	int status;
+	pid_t pid = wait(&status);
+	
+	for (int i = 0; i < gBatch.num && pid > 0; ++i)
 	{
-		// saria crash fix
+		struct batchJob *job = &gBatch.job[i];
+		
+		if (job->pid == pid)
 		{
-			uint8_t *saria = rom + 0x00EAB540;
-			
-			// restore original assembly
-			wBEu32(saria + 0xD98 + 0, 0x3C0E8016); // lui t6, 0x8016
-			wBEu32(saria + 0xD98 + 4, 0xA6000210); // sh r0, 0x0210(s0)
-			
-			// disable Kokiri Forest cutscene
-			wBEu32(saria + 0x9C4, 0x24020003); // addiu v0, r0, 0x0003 ; make branch 4 function same as branch 3
+			job->ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+			job->pid = 0;
+			break;
 		}
+	}
+	
+	return running - 1;
+}
+
+/* fix every queued file, each in its own worker process, so a bad
+ * file can't take the others down and its memory is returned as
+ * soon as it is done; at most gBatch.jobs run at once
+ * returns the number of files that failed
+ */
+int batch_run(bool bps)
+{
+	int running = 0;
+	int failed = 0;
+	int prefetched = 0;
+	
+	for (int i = 0; i < gBatch.num; ++i)
+	{
+		struct batchJob *job = &gBatch.job[i];
 		
-		// ganon battle fixes
+		// keep the next round of inputs loading while this one runs
+		for (; prefetched < gBatch.num && prefetched <= i + gBatch.jobs; ++prefetched)
+			batch_prefetch(gBatch.job[prefetched].fn);
+		
+		while (running >= gBatch.jobs)
+			running = batch_reap(running);
+		
+		fflush(stdout);
+		fflush(stderr);
+		if ((job->pid = fork()) < 0)
 		{
-			fprintf(stderr, "applying ganon battle fixes\n");
-			
-			// update rauru cutscene to use function 0x5e
-			// (aka so it jumps to ENTR_SPOT20_1)
-			rom[0x2B0D681] = 0x5e;
-			
-			// update entrance ENTR_SPOT20_1 aka 0x2ae
-			// to point to ganon battle
-			for (int i = 0; i < 4; ++i)
-				wBEu32(rom + 0xB9FE18 + i * 4, 0x4f004183);
-			
-			// restore missing zelda object in ganon battle
-			rom[0x353f031] = 0x08;
-			rom[0x353f064] = 0x00;
-			rom[0x353f064 + 1] = 0x60;
-			
-			// skip first ganon battle arena cutscene
-			wBEu32(rom + 0x3536328 + 0, 0x00760000);
-			wBEu32(rom + 0x3536328 + 4, 0x00010001);
-			
-			// now hide zelda using a more stable method
-			{
-				uint8_t *zl3 = rom + 0xF090B0;
-				
-				for (int i = 0; i < 4; ++i)
-				{
-					// make ctor/dtor/main/draw do nothing
-					wBEu32(zl3 + 0x71D4 + i * 4, 0x80035118);
-					
-					// also ensure their addresses won't be relocated
-					wBEu32(zl3 + 0x838C + i * 4, 0x82000184);
-				}
-			}
-			
-			// and mute zelda's voice
-			{
-				uint32_t off[] = { 0x28a6c0, 0x28dd00, 0x28eaA0, 0x289720, 0x28ba90 };
-				uint32_t sz[] = { 0x13cc, 0xD92, 0x161e, 0xf9c, 0x226c };
-				
-				for (int i = 0; i < 5; ++i)
-					memset(rom + off[i], 0, sz[i]);
-			}
+			// out of processes; do this one here
+			job->pid = 0;
+			job->ok = fix_file(job->fn, job->ofn, bps);
+			continue;
 		}
+		
+		if (!job->pid)
+			_exit(fix_file(job->fn, job->ofn, bps) ? EXIT_SUCCESS : EXIT_FAILURE);
+		
+		++running;
 	}
 	
-	// update crc checksum
-	n64crc(rom);
+	while (running)
+		running = batch_reap(running);
+	
+	for (int i = 0; i < gBatch.num; ++i)
+	{
+		struct batchJob *job = &gBatch.job[i];
+		
+		printf("%-7s %s -> %s\n", job->ok ? "ok" : "FAILED", job->fn, job->ofn);
+		failed += !job->ok;
+		free(job->fn);
+		free(job->ofn);
+	}
+	printf("%d of %d files fixed\n", gBatch.num - failed, gBatch.num);
+	free(gBatch.job);
+	
+	return failed;
+}
+#endif
+
+/* print how to use the program
+ * returns -1, for main() to return
+ */
+static int usage(void)
+{
+	fprintf(stderr, "args:\n" PROGNAME " [options] \"infile.zworld\" \"outfile.zworld\"\n");
+	fprintf(stderr, "outfile is optional; if not specified, infile is overwritten\n");
+	fprintf(stderr, "either can be - for stdin/stdout, e.g. zcat rom.z64.gz | " PROGNAME " - -\n");
+	fprintf(stderr, "supports both scene and room files, hence zworld\n");
+	fprintf(stderr, "misc fixes are applied if you throw a rom at it (recommended)\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  --bps              write a BPS patch to outfile instead of the fixed file\n");
+	fprintf(stderr, "  --crc-cache=FILE   checkpoint the checksum in FILE, so reruns only\n");
+	fprintf(stderr, "                     rehash the part of the rom that changed\n");
+	fprintf(stderr, "  --defrag           relocate scenes, rooms, objects, and actors to close\n");
+	fprintf(stderr, "                     gaps left by shrunk files, then truncate the rom\n");
+	fprintf(stderr, "  --dedup            point identical scenes, rooms, objects, and actors\n");
+	fprintf(stderr, "                     at one copy (combine with --defrag to reclaim space)\n");
+	fprintf(stderr, "  --compress         write a yaz0-compressed rom to outfile\n");
+	fprintf(stderr, "  --compress-skip=LIST  dmadata indices to store uncompressed, such\n");
+	fprintf(stderr, "                     as big scenes that load too slowly (e.g. 1000-1010,1200)\n");
+	fprintf(stderr, "  --incremental=FILE  keep a hash of every file in FILE, so reruns only fix\n");
+	fprintf(stderr, "                     the scenes and tables that changed (the checksum is\n");
+	fprintf(stderr, "                     cached in FILE.crc unless --crc-cache is given)\n");
+	fprintf(stderr, "  --manifest         instead of fixing infile, write the start, end, type,\n");
+	fprintf(stderr, "                     table index, and hash of every file in it to outfile\n");
+	fprintf(stderr, "                     (default: stdout), sorted, for verifying or diffing roms\n");
+	fprintf(stderr, "  --index=FILE       write an index of every scene's headers, rooms, and actor\n");
+	fprintf(stderr, "                     lists for other tools, keyed by the output file's hash\n");
+	fprintf(stderr, "  --stats[=FILE]     append a line of json with the time spent in each phase\n");
+	fprintf(stderr, "                     and counts of what was fixed to FILE (default: stderr)\n");
+	fprintf(stderr, "  --perf             add hardware counters to --stats, where the kernel allows\n");
+	#ifndef _WIN32
+	fprintf(stderr, "  --low-mem          drop each scene and room from memory once it is fixed,\n");
+	fprintf(stderr, "                     so memory use follows the largest file, not the rom\n");
+	fprintf(stderr, "batch mode:\n");
+	fprintf(stderr, PROGNAME " --batch [options] inputs...\n");
+	fprintf(stderr, "  inputs are files, directories (every .z64 and .zworld in them, recursively),\n");
+	fprintf(stderr, "  or @manifest.txt (one path per line); a summary is printed at the end\n");
+	fprintf(stderr, "  --out-dir=DIR      write results to DIR instead of fixing files in place\n");
+	fprintf(stderr, "                     (with --bps, patches are named after the input + .bps)\n");
+	fprintf(stderr, "  --jobs=N           files to fix at once (default: one per cpu)\n");
+	#endif
+	fprintf(stderr, "re-signing:\n");
+	fprintf(stderr, PROGNAME " --resign roms...\n");
+	fprintf(stderr, "  recalculate the checksum of each rom in place, several at once, without\n");
+	fprintf(stderr, "  fixing anything\n");
+	fprintf(stderr, "testing:\n");
+	fprintf(stderr, "  --synth=FILE[,ROOMS[,ACTORS[,SEED]]]  write a synthetic rom with up to ROOMS\n");
+	fprintf(stderr, "                     rooms per scene and ACTORS actors per room (or a lone\n");
+	fprintf(stderr, "                     room, if FILE ends in .zworld) to FILE\n");
+	#ifndef _WIN32
+	fprintf(stderr, "  --bench[=N]        time the main passes on synthetic roms, averaging N runs\n");
+	#endif
+	#ifdef _WIN32
+	fprintf(stderr, "simple drag-n-drop style win32 application\n");
+	fprintf(stderr, "(aka close this window and drag a zworld onto the exe)\n");
+	fprintf(stderr, "(warning: it will modify the input file, keep a backup!)\n");
+	getchar();
+	#endif
+	return -1;
 }
 
 int main(int argc, char *argv[])
 {
-	const char *ofn = argv[2];
-	const char *fn = argv[1];
-	uint8_t *room;
-	size_t roomSz;
+	const char *ofn = 0;
+	const char *fn = 0;
+	const char *synth = 0;
+	int benchIters = 0;
+	bool manifest = false;
+	bool resign = false;
+	bool batch = false;
+	bool bps = false;
+	int nargs = 0;
 	
 	fprintf(stderr, PROGNAME " <z64.me>\n");
 	
-	if (!ofn)
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+		
+		if (!strcmp(arg, "--bps"))
+			bps = true;
+		else if (!strncmp(arg, "--crc-cache=", 12))
+			gOpt.crcCache = arg + 12;
+		else if (!strcmp(arg, "--defrag"))
+			gOpt.defrag = true;
+		else if (!strcmp(arg, "--dedup"))
+			gOpt.dedup = true;
+		else if (!strcmp(arg, "--compress"))
+			gOpt.compress = true;
+		else if (!strncmp(arg, "--compress-skip=", 16))
+			gOpt.compressSkip = arg + 16;
+		else if (!strcmp(arg, "--low-mem"))
+			gOpt.lowMem = true;
+		else if (!strcmp(arg, "--stats"))
+			gOpt.stats = true;
+		else if (!strncmp(arg, "--stats=", 8))
+			gOpt.stats = true, gOpt.statsFn = arg + 8;
+		else if (!strcmp(arg, "--perf"))
+			gOpt.perf = true;
+		else if (!strncmp(arg, "--incremental=", 14))
+			gOpt.incremental = arg + 14;
+		else if (!strncmp(arg, "--index=", 8))
+			gOpt.index = arg + 8;
+		else if (!strcmp(arg, "--manifest"))
+			manifest = true;
+		else if (!strcmp(arg, "--batch"))
+			batch = true;
+		else if (!strcmp(arg, "--resign"))
+			resign = true;
+		else if (!strncmp(arg, "--synth=", 8))
+			synth = arg + 8;
+		else if (!strcmp(arg, "--bench"))
+			benchIters = 5;
+		else if (!strncmp(arg, "--bench=", 8))
+			benchIters = atoi(arg + 8);
+		#ifndef _WIN32
+		else if (!strncmp(arg, "--out-dir=", 10))
+			gBatch.outDir = arg + 10;
+		else if (!strncmp(arg, "--jobs=", 7))
+			gBatch.jobs = atoi(arg + 7);
+		#endif
+		else if (!strncmp(arg, "--", 2))
+		{
+			// a typo, not a file name
+			fprintf(stderr, "unknown option '%s'\n", arg);
+			return usage();
+		}
+		else if (++nargs == 1)
+			fn = arg;
+		else
+			ofn = arg;
+	}
+	
+	if (synth)
+		return synth_file(synth) ? 0 : -1;
+	
+	#ifndef _WIN32
+	if (benchIters)
+		return bench(benchIters) ? 0 : -1;
+	#endif
+	
+	if (resign && nargs)
+	{
+		char **list = malloc(nargs * sizeof(*list));
+		int num = 0;
+		int failed;
+		
+		if (!list)
+			return -1;
+		for (int i = 1; i < argc; ++i)
+			if (strncmp(argv[i], "--", 2))
+				list[num++] = argv[i];
+		
+		failed = resign_files(list, num);
+		fprintf(stderr, "re-signed %d of %d roms\n", num - failed, num);
+		free(list);
+		return failed ? -1 : 0;
+	}
+	
+	// reads the rom only, so no outfile means stdout
+	if (manifest && !batch && (nargs == 1 || nargs == 2))
+		return write_manifest(fn, ofn) ? 0 : -1;
+	
+	if (!ofn && !bps)
 		ofn = fn;
 	
-	if (argc != 2 && argc != 3)
-	{
-		fprintf(stderr, "args:\n" PROGNAME " \"infile.zworld\" \"outfile.zworld\"\n");
-		fprintf(stderr, "outfile is optional; if not specified, infile is overwritten\n");
-		fprintf(stderr, "supports both scene and room files, hence zworld\n");
-		fprintf(stderr, "misc fixes are applied if you throw a rom at it (recommended)\n");
-		#ifdef _WIN32
-		fprintf(stderr, "simple drag-n-drop style win32 application\n");
-		fprintf(stderr, "(aka close this window and drag a zworld onto the exe)\n");
-		fprintf(stderr, "(warning: it will modify the input file, keep a backup!)\n");
-		getchar();
-		#endif
+	if (batch ? !nargs : (nargs != 1 && !(nargs == 2 && ofn)))
+		return usage();
+	
+	if (bps && gOpt.compress)
+	{
+		fprintf(stderr, "--bps and --compress cannot be combined\n");
 		return -1;
 	}
 	
-	if (!(room = loadfile(fn, &roomSz)))
+	// the json would land in the middle of the rom or patch
+	if (gOpt.statsFn && !strcmp(gOpt.statsFn, "-") && !batch && ofn && is_stream(ofn))
 	{
-		fprintf(stderr, "failed to open or read input file '%s'\n", fn);
+		fprintf(stderr, "--stats=- cannot be combined with writing to stdout\n");
 		return -1;
 	}
 	
-	if (is_header(room, roomSz, 0x03000000))
+	// those repoint rooms found by walking every scene
+	if (gOpt.incremental && (gOpt.defrag || gOpt.dedup))
 	{
-		do_header(room, &roomSz, 0x03000000, 0);
+		fprintf(stderr, "--incremental cannot be combined with --defrag or --dedup\n");
+		return -1;
 	}
-	else if (roomSz > OOT_SCENE_TABLE_END)
+	
+	if (batch)
 	{
-		do_rom(room, roomSz);
+		#ifndef _WIN32
+		if (gOpt.crcCache)
+		{
+			fprintf(stderr, "--crc-cache cannot be used in batch mode\n");
+			return -1;
+		}
+		
+		if (gOpt.index)
+		{
+			fprintf(stderr, "--index cannot be used in batch mode\n");
+			return -1;
+		}
+		
+		if (gOpt.incremental)
+		{
+			fprintf(stderr, "--incremental cannot be used in batch mode\n");
+			return -1;
+		}
+		
+		if (manifest)
+		{
+			fprintf(stderr, "--manifest cannot be used in batch mode\n");
+			return -1;
+		}
+		
+		if (gBatch.jobs <= 0)
+			gBatch.jobs = num_cpus();
+		
+		for (int i = 1; i < argc; ++i)
+		{
+			if (!strncmp(argv[i], "--", 2))
+				continue;
+			
+			if (!batch_add_arg(argv[i], bps))
+			{
+				fprintf(stderr, "failed to read batch input '%s'\n", argv[i]);
+				return -1;
+			}
+		}
+		
+		if (!batch_check(!gBatch.outDir && !bps))
+		{
+			fprintf(stderr, "nothing was fixed\n");
+			return -1;
+		}
+		
+		return batch_run(bps) ? -1 : 0;
+		#else
+		fprintf(stderr, "batch mode is not supported on this platform\n");
+		return -1;
+		#endif
 	}
 	
-	if (!savefile(ofn, room, roomSz))
+	if (bps && !ofn)
 	{
-		fprintf(stderr, "failed to write output file '%s'\n", fn);
+		fprintf(stderr, "--bps requires an outfile to write the patch to\n");
 		return -1;
 	}
 	
-	free(room);
-	return 0;
+	// only rehash the part of the rom that changed, too
+	if (gOpt.incremental && !gOpt.crcCache)
+	{
+		char *crcCache;
+		
+		if (!(crcCache = malloc(strlen(gOpt.incremental) + 5)))
+			return -1;
+		sprintf(crcCache, "%s.crc", gOpt.incremental);
+		gOpt.crcCache = crcCache;
+	}
+	
+	return fix_file(fn, ofn, bps) ? 0 : -1;
 }